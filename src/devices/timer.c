@@ -3,10 +3,13 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,12 +20,33 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* List of processes in THREAD_BLOCK state by timer sleep */
-static struct list waiting_timer_list;
+/* 8254 input frequency divided by TIMER_FREQ, rounded to
+   nearest: the number of PIT input cycles in one timer tick. */
+#define PIT_TICK_COUNT ((1193180 + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks a single one-shot countdown can cover, since the
+   8254 counter is only 16 bits wide. */
+#define TICKLESS_MAX_TICKS (0xffff / PIT_TICK_COUNT)
+
+/* Binary min-heap of threads blocked in timer_sleep(), keyed on
+   alarm_ticks, so that the earliest deadline is always at
+   sleepers[0].  Every thread lives in its own page, so there can
+   never be more than ram_pages sleepers at once. */
+static struct thread **sleepers;
+static size_t sleeper_cnt;
+static size_t sleeper_max;
+
+/* Number of sleepers examined by timer_interrupt(). */
+static int64_t sleeper_checks;
 
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If nonzero, the PIT is counting down a one-shot interval of
+   this many ticks for the idle thread instead of interrupting
+   periodically.  See timer_tickless_enter(). */
+static int tickless_ticks;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -31,6 +55,10 @@ static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void sleepers_push (struct thread *);
+static struct thread *sleepers_pop (void);
+static void pit_set_periodic (void);
+static int tickless_stop (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -38,15 +66,13 @@ static void real_time_sleep (int64_t num, int32_t denom);
 void
 timer_init (void)
 {
-  /* 8254 input frequency divided by TIMER_FREQ, rounded to
-     nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  size_t heap_pages = DIV_ROUND_UP (ram_pages * sizeof *sleepers, PGSIZE);
 
-  list_init (&waiting_timer_list);
+  sleepers = palloc_get_multiple (PAL_ASSERT, heap_pages);
+  sleeper_cnt = 0;
+  sleeper_max = heap_pages * PGSIZE / sizeof *sleepers;
 
-  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-  outb (0x40, count & 0xff);
-  outb (0x40, count >> 8);
+  pit_set_periodic ();
 
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -106,7 +132,7 @@ timer_sleep (int64_t ticks)
 
   curr_thread->alarm_ticks = ticks + timer_ticks();
 
-  list_push_front (&waiting_timer_list, &curr_thread->elem);
+  sleepers_push (curr_thread);
   thread_block();
 
   intr_set_level(old_level);
@@ -138,31 +164,181 @@ void
 timer_print_stats (void)
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" sleeper checks\n", timer_sleeper_checks ());
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts with nothing to run.  Stops the periodic tick and
+   programs the PIT to interrupt once, when the earliest sleeper
+   is due (or as late as the 16-bit counter allows).  Does
+   nothing if that is no more than a tick away. */
+void
+timer_tickless_enter (void)
+{
+  int64_t delta = TICKLESS_MAX_TICKS;
+  uint16_t count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (tickless_ticks == 0);
+
+  if (sleeper_cnt > 0 && sleepers[0]->alarm_ticks - ticks < delta)
+    delta = sleepers[0]->alarm_ticks - ticks;
+  if (delta <= 1)
+    return;
+
+  tickless_ticks = delta;
+  count = delta * PIT_TICK_COUNT;
+  outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+  outb (0x40, count & 0xff);
+  outb (0x40, count >> 8);
+}
+
+/* Called by the scheduler, with interrupts off, whenever the CPU
+   leaves the idle thread, which may be after an interrupt other
+   than the timer's woke it from a tickless halt.  Brings `ticks'
+   up to date with the time that has passed and restores the
+   periodic tick.  Any fraction of a tick that had elapsed is
+   lost.  Does nothing outside a tickless interval. */
+void
+timer_tickless_exit (void)
+{
+  int elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tickless_ticks == 0)
+    return;
+
+  elapsed = tickless_stop ();
+  ticks += elapsed;
+  thread_tick_skipped (elapsed);
+}
+
+/* Returns the number of sleeping threads the timer interrupt
+   handler has examined since the OS booted. */
+int64_t
+timer_sleeper_checks (void)
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t checks = sleeper_checks;
+  intr_set_level (old_level);
+  return checks;
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  struct list_elem *curr = list_begin (&waiting_timer_list);
-  struct list_elem *next;
-  struct thread *curr_thread;
-  enum intr_level old_level;
+  /* If this is the end of a tickless interval, account for the
+     ticks that were skipped before the one we are handling. */
+  if (tickless_ticks != 0)
+    {
+      int elapsed = tickless_stop ();
+      if (elapsed > 1)
+        {
+          ticks += elapsed - 1;
+          thread_tick_skipped (elapsed - 1);
+        }
+    }
 
   ticks++;
   thread_tick ();
 
-  if (!list_empty (&waiting_timer_list)) {
-    while (curr != list_end(&waiting_timer_list)) {
-      curr_thread = list_entry (curr, struct thread, elem);
-      curr = list_next(curr);
+  /* Only the threads that are due are ever looked at, plus the
+     one at the top of the heap that stops the loop. */
+  while (sleeper_cnt > 0) {
+    sleeper_checks++;
+    if (sleepers[0]->alarm_ticks > ticks)
+      break;
+    thread_unblock (sleepers_pop ());
+  }
+}
 
-      if (curr_thread->alarm_ticks <= ticks) {
-        list_remove(curr->prev);
-        thread_unblock(curr_thread);
-      }
-    }
+/* Programs PIT counter 0 to interrupt every PIT_TICK_COUNT input
+   cycles, that is, TIMER_FREQ times per second. */
+static void
+pit_set_periodic (void)
+{
+  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+  outb (0x40, PIT_TICK_COUNT & 0xff);
+  outb (0x40, PIT_TICK_COUNT >> 8);
+}
+
+/* Ends the current tickless interval, returning the PIT to
+   periodic mode, and returns the number of whole ticks that
+   passed since it started. */
+static int
+tickless_stop (void)
+{
+  uint8_t status;
+  uint16_t remaining;
+  int elapsed;
+
+  ASSERT (tickless_ticks != 0);
+
+  /* Read back counter 0's status and count.  Bit 7 of the status
+     is the OUT pin, which goes high when a mode 0 countdown
+     reaches zero. */
+  outb (0x43, 0xc2);    /* Read-back: status and count of counter 0. */
+  status = inb (0x40);
+  remaining = inb (0x40);
+  remaining |= inb (0x40) << 8;
+
+  if (status & 0x80)
+    elapsed = tickless_ticks;
+  else
+    elapsed = (tickless_ticks * PIT_TICK_COUNT - remaining) / PIT_TICK_COUNT;
+
+  tickless_ticks = 0;
+  pit_set_periodic ();
+  return elapsed;
+}
+
+/* Adds T to the sleeper heap.  Interrupts must be off. */
+static void
+sleepers_push (struct thread *t)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleeper_cnt < sleeper_max);
+
+  /* Sift up from the new leaf. */
+  for (i = sleeper_cnt++; i > 0; i = (i - 1) / 2) {
+    struct thread *parent = sleepers[(i - 1) / 2];
+    if (parent->alarm_ticks <= t->alarm_ticks)
+      break;
+    sleepers[i] = parent;
+  }
+  sleepers[i] = t;
+}
+
+/* Removes and returns the sleeper with the earliest alarm_ticks.
+   The heap must not be empty and interrupts must be off. */
+static struct thread *
+sleepers_pop (void)
+{
+  struct thread *top, *last;
+  size_t i, child;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sleeper_cnt > 0);
+
+  top = sleepers[0];
+  last = sleepers[--sleeper_cnt];
+
+  /* Sift the former last leaf down from the root. */
+  for (i = 0; (child = 2 * i + 1) < sleeper_cnt; i = child) {
+    if (child + 1 < sleeper_cnt
+        && sleepers[child + 1]->alarm_ticks < sleepers[child]->alarm_ticks)
+      child++;
+    if (last->alarm_ticks <= sleepers[child]->alarm_ticks)
+      break;
+    sleepers[i] = sleepers[child];
   }
+  sleepers[i] = last;
+
+  return top;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
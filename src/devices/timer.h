@@ -19,6 +19,10 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_tickless_enter (void);
+void timer_tickless_exit (void);
+
 void timer_print_stats (void);
+int64_t timer_sleeper_checks (void);
 
 #endif /* devices/timer.h */
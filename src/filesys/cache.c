@@ -0,0 +1,302 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors kept in the cache. */
+#define CACHE_SIZE 64
+
+/* Ticks between write-behind flushes of dirty sectors. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Most read-ahead requests waiting for the read-ahead thread. */
+#define RA_QUEUE_SIZE 32
+
+/* A cached sector of the file system disk. */
+struct cache_entry
+  {
+    disk_sector_t sector;               /* Sector held, if VALID. */
+    bool valid;                         /* Holds a sector? */
+    bool dirty;                         /* Differs from the disk? */
+    bool accessed;                      /* Used since the clock passed? */
+    bool read_ahead;                    /* Read ahead and not used yet? */
+    uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;          /* Guards the whole cache. */
+static size_t clock_hand;               /* Next entry the clock looks at. */
+
+/* Sectors waiting to be read ahead, as a ring. */
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_cnt;
+static struct condition ra_cond;        /* Signaled when ra_queue grows. */
+
+/* The sector the read-ahead thread is reading without holding
+   cache_lock, if RA_BUSY.  A write to it meanwhile sets RA_STALE,
+   and the sector read is then thrown away. */
+static disk_sector_t ra_sector;
+static bool ra_busy, ra_stale;
+
+/* Statistics. */
+static long long hit_cnt, miss_cnt, write_behind_cnt;
+static long long ra_fetch_cnt, ra_hit_cnt, ra_waste_cnt;
+
+static struct cache_entry *cache_lookup (disk_sector_t);
+static struct cache_entry *cache_get (disk_sector_t, bool need_read);
+static struct cache_entry *cache_evict (void);
+static void cache_write_back (struct cache_entry *);
+static void cache_flush_daemon (void *aux);
+static void cache_read_ahead_daemon (void *aux);
+
+/* Initializes the buffer cache and starts the threads that
+   periodically write dirty sectors back to disk and that read
+   sectors ahead. */
+void
+cache_init (void)
+{
+  lock_init (&cache_lock);
+  cond_init (&ra_cond);
+  thread_create ("cache-flush", PRI_DEFAULT, cache_flush_daemon, NULL, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, cache_read_ahead_daemon, NULL,
+                 NULL);
+}
+
+/* Writes every dirty sector back to disk.  Called when the file
+   system shuts down. */
+void
+cache_done (void)
+{
+  cache_flush ();
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER,
+   reading the sector from disk if it is not cached. */
+void
+cache_read (disk_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+   The sector is only marked dirty; it reaches the disk when it is
+   evicted or flushed.  A write of a whole sector does not read
+   the old contents first. */
+void
+cache_write (disk_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = cache_get (sector, size < DISK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (ra_busy && ra_sector == sector)
+    ra_stale = true;
+  lock_release (&cache_lock);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache, and
+   returns without waiting for it.  Does nothing if SECTOR is
+   already cached or queued, or if the queue is full. */
+void
+cache_read_ahead (disk_sector_t sector)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  if (cache_lookup (sector) != NULL || ra_cnt == RA_QUEUE_SIZE)
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+  for (i = 0; i < ra_cnt; i++)
+    if (ra_queue[(ra_head + i) % RA_QUEUE_SIZE] == sector)
+      {
+        lock_release (&cache_lock);
+        return;
+      }
+  ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE] = sector;
+  cond_signal (&ra_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].dirty)
+      cache_write_back (&cache[i]);
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %lld hits, %lld misses, %lld write-behinds\n",
+          hit_cnt, miss_cnt, write_behind_cnt);
+  printf ("Read-ahead: %lld sectors fetched, %lld used (%lld%%), "
+          "%lld evicted unused\n",
+          ra_fetch_cnt, ra_hit_cnt,
+          ra_fetch_cnt > 0 ? ra_hit_cnt * 100 / ra_fetch_cnt : 0,
+          ra_waste_cnt);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  Called with cache_lock held. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Returns the entry for SECTOR, loading it into the cache if
+   necessary.  A newly loaded sector is read from disk only if
+   NEED_READ is true.  Called with cache_lock held. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool need_read)
+{
+  struct cache_entry *e = cache_lookup (sector);
+
+  if (e != NULL)
+    {
+      hit_cnt++;
+      if (e->read_ahead)
+        {
+          ra_hit_cnt++;
+          e->read_ahead = false;
+        }
+      e->accessed = true;
+      return e;
+    }
+  miss_cnt++;
+
+  e = cache_evict ();
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  if (need_read)
+    disk_read (filesys_disk, sector, e->data);
+  return e;
+}
+
+/* Frees an entry with the clock algorithm, giving every recently
+   used entry a second chance, and returns it.  Called with
+   cache_lock held. */
+static struct cache_entry *
+cache_evict (void)
+{
+  for (;;)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (e->valid && e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+
+      if (e->valid && e->dirty)
+        cache_write_back (e);
+      if (e->valid && e->read_ahead)
+        ra_waste_cnt++;
+      e->valid = false;
+      e->dirty = false;
+      e->read_ahead = false;
+      return e;
+    }
+}
+
+/* Writes dirty entry E back to disk.  Called with cache_lock
+   held. */
+static void
+cache_write_back (struct cache_entry *e)
+{
+  ASSERT (e->valid && e->dirty);
+
+  disk_write (filesys_disk, e->sector, e->data);
+  e->dirty = false;
+  write_behind_cnt++;
+}
+
+/* Periodically writes dirty sectors back, so that a crash loses
+   at most FLUSH_INTERVAL ticks of writes. */
+static void
+cache_flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Reads the sectors queued by cache_read_ahead into the cache.
+   The disk is read without holding cache_lock, so that readers
+   can use the cache in the meantime. */
+static void
+cache_read_ahead_daemon (void *aux UNUSED)
+{
+  static uint8_t buffer[DISK_SECTOR_SIZE];
+
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_cond, &cache_lock);
+      ra_sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+      ra_cnt--;
+      if (cache_lookup (ra_sector) != NULL)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      ra_busy = true;
+      ra_stale = false;
+      lock_release (&cache_lock);
+
+      disk_read (filesys_disk, ra_sector, buffer);
+
+      lock_acquire (&cache_lock);
+      if (!ra_stale && cache_lookup (ra_sector) == NULL)
+        {
+          struct cache_entry *e = cache_evict ();
+
+          memcpy (e->data, buffer, DISK_SECTOR_SIZE);
+          e->sector = ra_sector;
+          e->valid = true;
+          e->accessed = true;
+          e->read_ahead = true;
+          ra_fetch_cnt++;
+        }
+      ra_busy = false;
+      lock_release (&cache_lock);
+    }
+}
@@ -1,6 +1,8 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
+#include <round.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -21,6 +23,54 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* A small directory is an array of entries, searched linearly.
+   Once it needs more than DIR_LINEAR_MAX slots it is rewritten in
+   hashed form: a header sector and BUCKET_CNT bucket sectors of
+   BUCKET_ENTRY_CNT entries each, starting at sector BUCKET_BASE
+   of the file.  A name goes in the
+   first bucket with a free slot, starting at bucket
+   hash_string (name) % BUCKET_CNT and probing forward, so a
+   lookup reads one bucket in the common case.  A removed entry
+   keeps its name as a tombstone, and probing stops at a bucket
+   with a slot that was never used.  Rebuilding the table writes
+   the new buckets outside the current ones and only then points
+   the header at them, so running out of disk space partway leaves
+   the directory as it was.  The new buckets go at sector 1 if
+   they fit before the current ones, else right after them, so a
+   table rebuilt at the same size alternates between two places
+   and the file stops growing. */
+#define DIR_LINEAR_MAX 32
+#define DIR_HASH_MAGIC 0x48534944       /* Never a valid sector. */
+#define DIR_HASH_BUCKETS 16             /* Buckets in a new hashed dir. */
+#define BUCKET_ENTRY_CNT (DISK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* First sector of a hashed directory.  MAGIC overlays the first
+   entry's INODE_SECTOR in a linear directory. */
+struct dir_header
+  {
+    disk_sector_t magic;                /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t slot_cnt;                  /* Entries in use or tombstones. */
+    uint32_t bucket_base;               /* Sector of the file with bucket 0. */
+  };
+
+/* A bucket of a hashed directory, one per sector. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRY_CNT];
+  };
+
+static bool read_header (const struct dir *, struct dir_header *);
+static off_t bucket_ofs (const struct dir_header *, uint32_t bucket);
+static bool hash_lookup (const struct dir *, const struct dir_header *,
+                         const char *, struct dir_entry *, off_t *);
+static bool hash_add (struct dir *, struct dir_header *,
+                      const struct dir_entry *);
+static bool hash_place (struct dir *, struct dir_header *,
+                        const struct dir_entry *, struct dir_bucket *);
+static bool rehash (struct dir *, uint32_t bucket_cnt);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -92,12 +142,16 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    return hash_lookup (dir, &h, name, ep, ofsp);
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -141,6 +195,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -156,6 +211,16 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+  if (read_header (dir, &h))
+    {
+      memset (&e, 0, sizeof e);
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = hash_add (dir, &h, &e);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -168,7 +233,17 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
     if (!e.in_use)
       break;
 
+  /* A linear directory that has run out of slots turns into a
+     hashed one. */
+  if (ofs / sizeof e >= DIR_LINEAR_MAX)
+    {
+      if (rehash (dir, DIR_HASH_BUCKETS))
+        return dir_add (dir, name, inode_sector);
+      goto done;
+    }
+
   /* Write slot. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
@@ -184,6 +259,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -201,10 +277,16 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry.  Its name stays behind as a tombstone
+     for hashed directories. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (read_header (dir, &h))
+    {
+      h.entry_cnt--;
+      inode_write_at (dir->inode, &h, sizeof h, 0);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
@@ -221,11 +303,22 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool hashed = read_header (dir, &h);
+
+  /* Skip the header of a hashed directory, and anything else
+     outside its buckets. */
+  if (hashed && dir->pos < bucket_ofs (&h, 0))
+    dir->pos = bucket_ofs (&h, 0);
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  while ((!hashed || dir->pos < bucket_ofs (&h, h.bucket_cnt))
+         && inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
+      /* Skip the padding at the end of a bucket. */
+      if (hashed && dir->pos % DISK_SECTOR_SIZE + sizeof e > DISK_SECTOR_SIZE)
+        dir->pos = ROUND_UP (dir->pos, DISK_SECTOR_SIZE);
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
@@ -234,3 +327,233 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Reads DIR's header into *H and returns true if DIR is hashed,
+   otherwise returns false. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_HASH_MAGIC);
+}
+
+/* Returns the byte offset of BUCKET in a hashed directory with
+   header H. */
+static off_t
+bucket_ofs (const struct dir_header *h, uint32_t bucket)
+{
+  return (off_t) (h->bucket_base + bucket) * DISK_SECTOR_SIZE;
+}
+
+/* Searches hashed directory DIR, whose header is H, for NAME, as
+   lookup() does. */
+static bool
+hash_lookup (const struct dir *dir, const struct dir_header *h,
+             const char *name, struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_bucket *b = malloc (sizeof *b);
+  uint32_t bucket = hash_string (name) % h->bucket_cnt;
+  bool found = false;
+  uint32_t i;
+
+  if (b == NULL)
+    return false;
+
+  for (i = 0; i < h->bucket_cnt && !found; i++)
+    {
+      uint32_t cur = (bucket + i) % h->bucket_cnt;
+      bool end = false;
+      size_t j;
+
+      if (inode_read_at (dir->inode, b, sizeof *b, bucket_ofs (h, cur))
+          != sizeof *b)
+        break;
+      for (j = 0; j < BUCKET_ENTRY_CNT; j++)
+        {
+          struct dir_entry *e = &b->entries[j];
+
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = bucket_ofs (h, cur) + j * sizeof *e;
+              found = true;
+              break;
+            }
+          if (!e->in_use && e->name[0] == '\0')
+            end = true;
+        }
+      if (end)
+        break;
+    }
+  free (b);
+  return found;
+}
+
+/* Adds E, whose name is not in DIR, to hashed directory DIR with
+   header H, growing the directory first if it is getting full. */
+static bool
+hash_add (struct dir *dir, struct dir_header *h, const struct dir_entry *e)
+{
+  struct dir_bucket *b;
+  bool success;
+
+  /* Keep buckets at most three-quarters full, counting
+     tombstones, which rehashing drops. */
+  if ((h->slot_cnt + 1) * 4 > h->bucket_cnt * BUCKET_ENTRY_CNT * 3)
+    {
+      uint32_t bucket_cnt = h->bucket_cnt;
+
+      if ((h->entry_cnt + 1) * 2 > bucket_cnt * BUCKET_ENTRY_CNT)
+        bucket_cnt *= 2;
+      if (!rehash (dir, bucket_cnt) || !read_header (dir, h))
+        return false;
+    }
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  success = (hash_place (dir, h, e, b)
+             && inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h);
+  free (b);
+  return success;
+}
+
+/* Writes E into the first free slot for it in the buckets of
+   hashed directory DIR described by H, using B as scratch space,
+   and counts it in H.  Does not write H. */
+static bool
+hash_place (struct dir *dir, struct dir_header *h,
+            const struct dir_entry *e, struct dir_bucket *b)
+{
+  uint32_t bucket = hash_string (e->name) % h->bucket_cnt;
+  uint32_t i;
+
+  for (i = 0; i < h->bucket_cnt; i++)
+    {
+      uint32_t cur = (bucket + i) % h->bucket_cnt;
+      size_t j;
+
+      if (inode_read_at (dir->inode, b, sizeof *b, bucket_ofs (h, cur))
+          != sizeof *b)
+        return false;
+      for (j = 0; j < BUCKET_ENTRY_CNT; j++)
+        if (!b->entries[j].in_use)
+          {
+            off_t ofs = bucket_ofs (h, cur) + j * sizeof *e;
+
+            if (b->entries[j].name[0] == '\0')
+              h->slot_cnt++;
+            h->entry_cnt++;
+            return (inode_write_at (dir->inode, e, sizeof *e, ofs)
+                    == sizeof *e);
+          }
+    }
+  return false;
+}
+
+/* Rewrites DIR as a hashed directory with BUCKET_CNT buckets,
+   holding the entries DIR has now, linear or hashed.  The new
+   buckets go where they do not overlap the entries in use, and
+   the header is switched over to them last.  Returns false,
+   leaving DIR's entries unchanged, if memory or disk space runs
+   out. */
+static bool
+rehash (struct dir *dir, uint32_t bucket_cnt)
+{
+  struct dir_header h, new_h;
+  struct dir_entry *entries = NULL;
+  struct dir_bucket *b;
+  size_t entry_cnt = 0, entry_max = 0;
+  bool hashed = read_header (dir, &h);
+  off_t ofs = hashed ? bucket_ofs (&h, 0) : 0;
+  off_t end = (hashed ? bucket_ofs (&h, h.bucket_cnt)
+               : inode_length (dir->inode));
+  struct dir_entry e;
+  bool success = true;
+  uint32_t i;
+
+  /* Gather the entries in use. */
+  for (; ofs < end
+         && inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    {
+      if (hashed && ofs % DISK_SECTOR_SIZE + sizeof e > DISK_SECTOR_SIZE)
+        {
+          /* Padding at the end of a bucket. */
+          ofs = ROUND_UP (ofs, DISK_SECTOR_SIZE) - sizeof e;
+          continue;
+        }
+      if (!e.in_use)
+        continue;
+      if (entry_cnt == entry_max)
+        {
+          struct dir_entry *new;
+
+          entry_max = entry_max ? entry_max * 2 : DIR_LINEAR_MAX;
+          new = realloc (entries, entry_max * sizeof *entries);
+          if (new == NULL)
+            {
+              free (entries);
+              return false;
+            }
+          entries = new;
+        }
+      entries[entry_cnt++] = e;
+    }
+
+  /* Leave hash_add room for every entry without another rehash. */
+  while ((entry_cnt + 1) * 4 > bucket_cnt * BUCKET_ENTRY_CNT * 3)
+    bucket_cnt *= 2;
+
+  b = calloc (1, sizeof *b);
+  if (b == NULL)
+    {
+      free (entries);
+      return false;
+    }
+
+  /* Lay out empty buckets: past the end of a linear directory,
+     otherwise in the free space before or after the current
+     buckets.  This is the step that may allocate disk space, and
+     a failure here leaves only unused slots behind. */
+  memset (&new_h, 0, sizeof new_h);
+  new_h.magic = DIR_HASH_MAGIC;
+  new_h.bucket_cnt = bucket_cnt;
+  if (!hashed)
+    new_h.bucket_base = DIV_ROUND_UP (inode_length (dir->inode),
+                                      DISK_SECTOR_SIZE);
+  else if (1 + bucket_cnt <= h.bucket_base)
+    new_h.bucket_base = 1;
+  else
+    new_h.bucket_base = h.bucket_base + h.bucket_cnt;
+  for (i = 0; i < bucket_cnt && success; i++)
+    success = (inode_write_at (dir->inode, b, sizeof *b,
+                               bucket_ofs (&new_h, i)) == sizeof *b);
+  if (!success)
+    goto done;
+
+  /* Fill them in, then switch the header over. */
+  for (i = 0; i < entry_cnt && success; i++)
+    success = hash_place (dir, &new_h, &entries[i], b);
+  if (success)
+    success = (inode_write_at (dir->inode, &new_h, sizeof new_h, 0)
+               == sizeof new_h);
+
+  /* On failure, clear out what was placed, so that a linear
+     directory, which is read to the end of the file, does not
+     see its entries twice.  These sectors were all written above,
+     so this cannot run out of disk space. */
+  if (!success)
+    {
+      memset (b, 0, sizeof *b);
+      for (i = 0; i < bucket_cnt; i++)
+        inode_write_at (dir->inode, b, sizeof *b, bucket_ofs (&new_h, i));
+    }
+
+ done:
+  free (b);
+  free (entries);
+  return success;
+}
@@ -1,23 +1,13 @@
 #include "filesys/file.h"
 #include <debug.h>
-#include <list.h>
 #include "filesys/inode.h"
-#include "threads/thread.h"
 #include "threads/malloc.h"
-#include "threads/synch.h"
 
-static int
-allocate_fd (void)
-{
-  static int next_fd = 2;
-  int fd;
-
-  lock_acquire (&fd_lock);
-  fd = next_fd++;
-  lock_release (&fd_lock);
+/* Read-ahead window bounds, in sectors. */
+#define RA_WINDOW_MIN 2
+#define RA_WINDOW_MAX 16
 
-  return fd;
-}
+static void file_read_ahead (struct file *, off_t);
 
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
@@ -28,11 +18,9 @@ file_open (struct inode *inode)
   struct file *file = calloc (1, sizeof *file);
   if (inode != NULL && file != NULL)
     {
-      file->fd = allocate_fd();
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
-      list_push_front(&thread_current()->file_list, &file->elem);
       return file;
     }
   else
@@ -48,7 +36,10 @@ file_open (struct inode *inode)
 struct file *
 file_reopen (struct file *file)
 {
-  return file_open (inode_reopen (file->inode));
+  struct file *new = file_open (inode_reopen (file->inode));
+  if (new != NULL)
+    new->read_only = file->read_only;
+  return new;
 }
 
 /* Closes FILE. */
@@ -58,7 +49,6 @@ file_close (struct file *file)
   if (file != NULL)
     {
       file_allow_write (file);
-      list_remove(&file->elem);
       inode_close (file->inode);
       free (file);
     }
@@ -80,10 +70,51 @@ off_t
 file_read (struct file *file, void *buffer, off_t size)
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  file_read_ahead (file, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
 
+/* Updates FILE's read-ahead state for a read of BYTES_READ bytes
+   at its current position.  A read that starts where the last
+   one ended is sequential, and sectors past it are read ahead in
+   the background.  The window doubles whenever the reader gets
+   into data that was read ahead for it, and halves when it seeks
+   away, wasting what was read ahead but not used. */
+static void
+file_read_ahead (struct file *file, off_t bytes_read)
+{
+  off_t end = file->pos + bytes_read;
+
+  if (file->pos != file->ra_next)
+    {
+      if (file->ra_end > file->ra_next)
+        file->ra_window /= 2;
+      file->ra_end = 0;
+    }
+  else if (bytes_read > 0)
+    {
+      off_t ra_start;
+
+      if (file->ra_end > file->pos)
+        file->ra_window *= 2;
+      if (file->ra_window < RA_WINDOW_MIN)
+        file->ra_window = RA_WINDOW_MIN;
+      else if (file->ra_window > RA_WINDOW_MAX)
+        file->ra_window = RA_WINDOW_MAX;
+
+      ra_start = file->ra_end > end ? file->ra_end : end;
+      if (end + file->ra_window * DISK_SECTOR_SIZE > ra_start)
+        {
+          inode_read_ahead (file->inode,
+                            end + file->ra_window * DISK_SECTOR_SIZE
+                            - ra_start, ra_start);
+          file->ra_end = end + file->ra_window * DISK_SECTOR_SIZE;
+        }
+    }
+  file->ra_next = end;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -105,7 +136,11 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size)
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  if (file->read_only)
+    return 0;
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -121,6 +156,8 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs)
 {
+  if (file->read_only)
+    return 0;
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
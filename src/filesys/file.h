@@ -5,16 +5,19 @@
 #include "threads/synch.h"
 
 struct inode;
-struct lock fd_lock;
 
 /* An open file. */
 struct file
   {
-    int fd;                     /* File descriptor */
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
-    struct list_elem elem;      /* Elem for file_list */
+    bool read_only;             /* Opened on a directory: no writes. */
+
+    /* Sequential read-ahead. */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_end;               /* End of the data read ahead so far. */
+    int ra_window;              /* Sectors to read ahead. */
   };
 
 /* Opening and closing files. */
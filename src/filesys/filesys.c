@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -22,9 +23,9 @@ filesys_init (bool format)
   if (filesys_disk == NULL)
     PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+  cache_init ();
   inode_init ();
   free_map_init ();
-  lock_init(&fd_lock);
 
   if (format)
     do_format ();
@@ -38,6 +39,7 @@ void
 filesys_done (void)
 {
   free_map_close ();
+  cache_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -68,9 +70,20 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
 
+  /* "/" is the root directory itself.  It can be read, and its
+     length taken, but only the directory code writes it. */
+  if (!strcmp (name, "/"))
+    {
+      struct file *file = file_open (inode_open (ROOT_DIR_SECTOR));
+      if (file != NULL)
+        file->read_only = true;
+      return file;
+    }
+
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
@@ -3,6 +3,7 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,14 +11,43 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Extents held in the inode itself, and in an extent block. */
+#define INODE_EXTENT_CNT 41
+#define BLOCK_EXTENT_CNT 42
+
+/* A run of LENGTH data sectors starting at disk sector START,
+   holding the file's sectors from file sector OFS on. */
+struct extent
+  {
+    uint32_t ofs;                       /* First file sector. */
+    disk_sector_t start;                /* First disk sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
 /* On-disk inode.
-   Must be exactly DISK_SECTOR_SIZE bytes long. */
+   Must be exactly DISK_SECTOR_SIZE bytes long.
+
+   The file's data is described by a list of extents: the first
+   INODE_EXTENT_CNT live in the inode, and the rest in a chain of
+   extent blocks starting at NEXT.  File sectors that no extent
+   covers are not allocated and read as zeros. */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
+    struct extent extents[INODE_EXTENT_CNT]; /* First extents. */
+    uint32_t extent_cnt;                /* Extents in use in EXTENTS. */
+    disk_sector_t next;                 /* First extent block, or 0. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t unused[1];                 /* Not used. */
+  };
+
+/* Overflow extents, chained from the inode.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block
+  {
+    struct extent extents[BLOCK_EXTENT_CNT]; /* More extents. */
+    uint32_t extent_cnt;                /* Extents in use in EXTENTS. */
+    disk_sector_t next;                 /* Next extent block, or 0. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -39,18 +69,173 @@ struct inode
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the disk sector that contains byte offset POS within
-   INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Returns the disk sector holding file sector IDX in the CNT
+   extents at EXTENTS, or 0 if none of them covers it. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+extent_find (const struct extent *extents, uint32_t cnt, uint32_t idx)
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
+  uint32_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (idx >= extents[i].ofs && idx - extents[i].ofs < extents[i].length)
+      return extents[i].start + (idx - extents[i].ofs);
+  return 0;
+}
+
+/* Allocates a zeroed sector, as close after GOAL as possible, and
+   stores it in *SECTORP.  Returns false if the disk is full. */
+static bool
+allocate_zeroed (disk_sector_t goal, disk_sector_t *sectorp)
+{
+  static char zeros[DISK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near (goal, 1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros, 0, DISK_SECTOR_SIZE);
+  return true;
+}
+
+/* Allocates file sector IDX of DISK_INODE, which is stored in
+   sector INODE_SECTOR, and returns its disk sector, or 0 if the
+   disk is full.  If IDX follows the last extent, the allocator
+   first tries the disk sector right after it, so that files
+   written sequentially stay contiguous; otherwise it looks near
+   the inode.  The caller must write DISK_INODE back. */
+static disk_sector_t
+allocate_sector (struct inode_disk *disk_inode, disk_sector_t inode_sector,
+                 uint32_t idx)
+{
+  struct extent_block *block = NULL;
+  disk_sector_t block_sector = 0;       /* Holds the tail, if nonzero. */
+  struct extent *tail = NULL;           /* Last extent, if any. */
+  disk_sector_t goal = inode_sector + 1;
+  disk_sector_t sector;
+
+  /* Find the last extent, which may be in the last extent block. */
+  if (disk_inode->next != 0)
+    {
+      block = malloc (sizeof *block);
+      if (block == NULL)
+        return 0;
+      for (block_sector = disk_inode->next; ; block_sector = block->next)
+        {
+          cache_read (block_sector, block, 0, DISK_SECTOR_SIZE);
+          if (block->next == 0)
+            break;
+        }
+      if (block->extent_cnt > 0)
+        tail = &block->extents[block->extent_cnt - 1];
+    }
+  else if (disk_inode->extent_cnt > 0)
+    tail = &disk_inode->extents[disk_inode->extent_cnt - 1];
+
+  if (tail != NULL && tail->ofs + tail->length == idx)
+    goal = tail->start + tail->length;
+  if (!allocate_zeroed (goal, &sector))
+    sector = 0;
+  else if (tail != NULL && tail->ofs + tail->length == idx && sector == goal)
+    tail->length++;
   else
-    return -1;
+    {
+      /* Start a new extent, in a new extent block if the last one
+         is full. */
+      struct extent *e;
+
+      if (block == NULL && disk_inode->extent_cnt < INODE_EXTENT_CNT)
+        e = &disk_inode->extents[disk_inode->extent_cnt++];
+      else if (block != NULL && block->extent_cnt < BLOCK_EXTENT_CNT)
+        e = &block->extents[block->extent_cnt++];
+      else
+        {
+          disk_sector_t new_sector;
+
+          if (block == NULL)
+            block = malloc (sizeof *block);
+          if (block == NULL || !allocate_zeroed (sector, &new_sector))
+            {
+              free_map_release (sector, 1);
+              free (block);
+              return 0;
+            }
+          if (block_sector != 0)
+            {
+              block->next = new_sector;
+              cache_write (block_sector, block, 0, DISK_SECTOR_SIZE);
+            }
+          else
+            disk_inode->next = new_sector;
+          memset (block, 0, sizeof *block);
+          block_sector = new_sector;
+          e = &block->extents[block->extent_cnt++];
+        }
+      e->ofs = idx;
+      e->start = sector;
+      e->length = 1;
+    }
+
+  if (sector != 0 && block_sector != 0)
+    cache_write (block_sector, block, 0, DISK_SECTOR_SIZE);
+  free (block);
+  return sector;
+}
+
+/* Stores in *SECTORP the disk sector that contains byte offset
+   POS within INODE, or 0 if no sector is allocated there.
+   Returns false, leaving *SECTORP unset, if memory runs out
+   before the extent blocks have been searched. */
+static bool
+byte_to_sector (struct inode *inode, off_t pos, disk_sector_t *sectorp) 
+{
+  uint32_t idx = pos / DISK_SECTOR_SIZE;
+  struct extent_block *block;
+  disk_sector_t next, sector;
+
+  ASSERT (inode != NULL);
+
+  sector = extent_find (inode->data.extents, inode->data.extent_cnt, idx);
+  if (sector == 0 && inode->data.next != 0)
+    {
+      block = malloc (sizeof *block);
+      if (block == NULL)
+        return false;
+      for (next = inode->data.next; sector == 0 && next != 0;
+           next = block->next)
+        {
+          cache_read (next, block, 0, DISK_SECTOR_SIZE);
+          sector = extent_find (block->extents, block->extent_cnt, idx);
+        }
+      free (block);
+    }
+  *sectorp = sector;
+  return true;
+}
+
+/* Releases every data sector and extent block of DISK_INODE. */
+static void
+deallocate (struct inode_disk *disk_inode)
+{
+  struct extent_block *block;
+  disk_sector_t next;
+  uint32_t i;
+
+  for (i = 0; i < disk_inode->extent_cnt; i++)
+    free_map_release (disk_inode->extents[i].start,
+                      disk_inode->extents[i].length);
+  if (disk_inode->next == 0)
+    return;
+
+  block = malloc (sizeof *block);
+  if (block == NULL)
+    return;
+  for (next = disk_inode->next; next != 0; next = block->next)
+    {
+      cache_read (next, block, 0, DISK_SECTOR_SIZE);
+      for (i = 0; i < block->extent_cnt; i++)
+        free_map_release (block->extents[i].start,
+                          block->extents[i].length);
+      free_map_release (next, 1);
+    }
+  free (block);
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -80,26 +265,28 @@ inode_create (disk_sector_t sector, off_t length)
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
 
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      size_t i;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
-        {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
-          success = true; 
-        } 
+
+      /* Sectors are allocated one at a time, so a fragmented
+         disk is no obstacle, but each extends the last extent
+         whenever the next disk sector is free. */
+      success = true;
+      for (i = 0; success && i < sectors; i++)
+        success = allocate_sector (disk_inode, sector, i) != 0;
+
+      if (success)
+        cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+      else
+        deallocate (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -137,7 +324,7 @@ inode_open (disk_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  disk_read (filesys_disk, inode->sector, &inode->data);
+  cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
   return inode;
 }
 
@@ -177,8 +364,7 @@ inode_close (struct inode *inode)
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          deallocate (&inode->data);
         }
 
       free (inode); 
@@ -202,12 +388,11 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -217,50 +402,58 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      if (chunk_size <= 0 || !byte_to_sector (inode, offset, &sector_idx))
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          disk_read (filesys_disk, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Asks the buffer cache to read ahead the sectors of INODE that
+   hold the SIZE bytes starting at OFFSET, without waiting for
+   them.  Sectors past the end of INODE are skipped. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+  off_t pos;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (pos = offset - offset % DISK_SECTOR_SIZE; pos < end;
+       pos += DISK_SECTOR_SIZE)
+    {
+      disk_sector_t sector;
+
+      if (!byte_to_sector (inode, pos, &sector))
+        break;
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.  A
+   write past end of file extends the inode, allocating only the
+   sectors it touches; any gap before it reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool changed = false;
 
   if (inode->deny_write_cnt)
     return 0;
@@ -268,51 +461,44 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector, lesser of that and SIZE. */
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      /* Only a sector known to be unallocated may be allocated. */
+      if (!byte_to_sector (inode, offset, &sector_idx))
         break;
-
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+          sector_idx = allocate_sector (&inode->data, inode->sector,
+                                        offset / DISK_SECTOR_SIZE);
+          if (sector_idx == 0)
+            break;
+          changed = true;
         }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            disk_read (filesys_disk, sector_idx, bounce);
-          else
-            memset (bounce, 0, DISK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          disk_write (filesys_disk, sector_idx, bounce); 
-        }
+      /* The cache reads the sector in first unless the chunk
+         covers all of it. */
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file only once its new data is in place. */
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
 
   return bytes_written;
 }
@@ -0,0 +1,154 @@
+/* First keeps CHURN_LIVE files in the root directory while
+   creating and removing CHURN_CNT more, as a log-writing service
+   would, and checks that the directory does not keep growing as
+   removed names pile up and force its table to be rebuilt.
+
+   Then creates FILE_CNT empty files in the root directory, opens
+   each of them, removes every other one, and checks that the
+   rest can still be found.  The root directory switches to its
+   hashed form early on, so each operation should read only a
+   bucket or two of it.  Reports the timer ticks each of these
+   four phases took: with a hashed directory they stay close to
+   proportional to FILE_CNT, where a linear scan would make them
+   grow with its square. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 5000
+#define CHURN_LIVE 199          /* Just too few to grow the table. */
+#define CHURN_CNT 10000
+
+static void
+file_name (char *name, size_t size, int i)
+{
+  snprintf (name, size, "f%d", i);
+}
+
+/* Returns the length of the root directory, in bytes. */
+static int
+root_length (void)
+{
+  int fd = open ("/");
+  int length;
+
+  if (fd < 2)
+    fail ("open \"/\"");
+  length = filesize (fd);
+  close (fd);
+  return length;
+}
+
+static void
+churn (void)
+{
+  static int live[CHURN_LIVE];
+  char name[16];
+  int start_length, max_length;
+  int i;
+
+  for (i = 0; i < CHURN_LIVE; i++)
+    {
+      snprintf (name, sizeof name, "c%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      live[i] = i;
+    }
+  start_length = max_length = root_length ();
+
+  /* Replace a random live file with a new one each time. */
+  random_init (0);
+  for (i = CHURN_LIVE; i < CHURN_LIVE + CHURN_CNT; i++)
+    {
+      int victim = random_ulong () % CHURN_LIVE;
+      int length;
+
+      snprintf (name, sizeof name, "c%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      snprintf (name, sizeof name, "c%d", live[victim]);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+      live[victim] = i;
+
+      length = root_length ();
+      if (length > max_length)
+        max_length = length;
+    }
+
+  /* Rebuilding the table at the same size may move it once, but
+     no more than that. */
+  if (max_length > 2 * start_length)
+    fail ("root directory grew from %d to %d bytes", start_length,
+          max_length);
+  msg ("created and removed %d files", CHURN_CNT);
+
+  for (i = 0; i < CHURN_LIVE; i++)
+    {
+      snprintf (name, sizeof name, "c%d", live[i]);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+}
+
+void
+test_main (void)
+{
+  char name[16];
+  int start;
+  int i;
+
+  churn ();
+
+  start = ticks ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, sizeof name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+  msg ("created %d files: %d ticks", FILE_CNT, ticks () - start);
+
+  start = ticks ();
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      file_name (name, sizeof name, i);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+  msg ("opened %d files: %d ticks", FILE_CNT, ticks () - start);
+
+  start = ticks ();
+
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      file_name (name, sizeof name, i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  msg ("removed %d files: %d ticks", FILE_CNT / 2, ticks () - start);
+
+  start = ticks ();
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      file_name (name, sizeof name, i);
+      fd = open (name);
+      if ((fd >= 2) != (i % 2 != 0))
+        fail ("open \"%s\" after removals", name);
+      if (fd >= 2)
+        close (fd);
+    }
+  msg ("looked up %d files after removals: %d ticks", FILE_CNT,
+       ticks () - start);
+}
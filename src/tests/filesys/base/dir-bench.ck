@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The tick counts vary from run to run, so check them for form
+# and then drop them from the comparison.
+for my $phase ('created 5000 files', 'opened 5000 files',
+	       'removed 2500 files', 'looked up 5000 files after removals') {
+    fail "missing timing for \"$phase\"\n"
+      if !grep (/^\(dir-bench\) $phase: \d+ ticks$/, @output);
+}
+@output = grep (!/^\(dir-bench\) .*: \d+ ticks$/, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(dir-bench) begin
+(dir-bench) created and removed 10000 files
+(dir-bench) end
+EOF
+pass;
@@ -0,0 +1,91 @@
+/* Creates 1,000 threads that all sleep at once, with deadlines
+   spread over 100 ticks, and measures how many sleepers the
+   timer interrupt handler examines while they wake up.  A
+   handler that only looks at threads that are due examines at
+   most one sleeper per wakeup plus one per tick. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 1000
+#define SPREAD 100
+
+/* Information about the test. */
+struct stress_test
+  {
+    int64_t start;              /* Tick at which sleepers start. */
+    int woken;                  /* Number of sleepers woken up. */
+    int late;                   /* Number that woke after deadline. */
+  };
+
+static void sleeper (void *);
+
+void
+test_alarm_stress (void)
+{
+  struct stress_test test;
+  int64_t checks, elapsed;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep up to %d ticks each.",
+       SLEEPER_CNT, SPREAD);
+
+  test.start = timer_ticks () + 500;
+  test.woken = 0;
+  test.late = 0;
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, &test, NULL)
+          == TID_ERROR)
+        fail ("could not create thread %d", i);
+    }
+
+  /* Wait until every sleeper has gone to sleep, then count
+     handler work over the window in which they all wake up. */
+  timer_sleep (test.start - timer_ticks ());
+  checks = timer_sleeper_checks ();
+  elapsed = timer_ticks ();
+  timer_sleep (SPREAD + 10);
+  checks = timer_sleeper_checks () - checks;
+  elapsed = timer_ticks () - elapsed;
+
+  if (test.woken != SLEEPER_CNT)
+    fail ("only %d of %d sleepers woke up", test.woken, SLEEPER_CNT);
+  if (test.late != 0)
+    fail ("%d sleepers woke up after their deadline", test.late);
+  msg ("%lld sleeper checks over %lld ticks (%lld per tick)",
+       checks, elapsed, checks / elapsed);
+  if (checks > SLEEPER_CNT + elapsed + 1)
+    fail ("timer interrupt examined %lld sleepers for %d wakeups",
+          checks, SLEEPER_CNT);
+
+  pass ();
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *test_)
+{
+  struct stress_test *test = test_;
+  int64_t deadline = test->start + 1 + thread_tid () % SPREAD;
+  enum intr_level old_level;
+
+  timer_sleep (deadline - timer_ticks ());
+
+  old_level = intr_disable ();
+  test->woken++;
+  if (timer_ticks () > deadline)
+    test->late++;
+  intr_set_level (old_level);
+}
@@ -0,0 +1,13 @@
+/* Child process of exec-bench.
+   Exits at once, so that exec-bench exercises little but exec
+   and wait themselves. */
+
+#include "tests/lib.h"
+
+const char *test_name = "child-bench";
+
+int
+main (void)
+{
+  return 0x2a;
+}
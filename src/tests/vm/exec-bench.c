@@ -0,0 +1,34 @@
+/* Execs ITER_CNT child-bench processes in turn, waiting for each
+   one, while the parent holds BUF_SIZE bytes of data, and reports
+   the timer ticks the loop took: the exec half of fork-bench, on
+   its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITER_CNT 50
+#define BUF_SIZE (256 * 1024)
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void)
+{
+  int start;
+  int i;
+
+  memset (buf, 0x5a, BUF_SIZE);
+  start = ticks ();
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      pid_t pid = exec ("child-bench");
+
+      if (pid == PID_ERROR)
+        fail ("exec %d failed", i);
+      if (wait (pid) != 0x2a)
+        fail ("child %d failed", i);
+    }
+  msg ("exec and wait %d children: %d ticks", ITER_CNT, ticks () - start);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The tick count varies from run to run, so check it for form and
+# then drop it from the comparison.
+fail "missing exec timing\n"
+  if !grep (/^\(exec-bench\) exec and wait 50 children: \d+ ticks$/,
+	    @output);
+@output = grep (!/^\(exec-bench\) exec and wait 50 children: \d+ ticks$/,
+		@output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(exec-bench) begin
+(exec-bench) end
+EOF
+pass;
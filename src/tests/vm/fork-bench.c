@@ -0,0 +1,70 @@
+/* Forks ITER_CNT children in turn, waiting for each one, while
+   the parent holds BUF_SIZE bytes of data.  Each child checks
+   that it sees the parent's data, then overwrites one page of
+   it, which must not show through to the parent.  Then execs
+   ITER_CNT child-bench processes the same way, and reports the
+   timer ticks each loop took, so that fork+wait latency can be
+   compared with exec+wait latency for the same parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITER_CNT 50
+#define BUF_SIZE (256 * 1024)
+#define PAGE_SIZE 4096
+
+static char buf[BUF_SIZE];
+
+static int
+child (int i)
+{
+  size_t ofs;
+
+  for (ofs = 0; ofs < BUF_SIZE; ofs += PAGE_SIZE)
+    if (buf[ofs] != 0x5a)
+      return -1;
+  buf[i * PAGE_SIZE % BUF_SIZE] = 0;
+  return i;
+}
+
+void
+test_main (void)
+{
+  size_t ofs;
+  int start;
+  int i;
+
+  memset (buf, 0x5a, BUF_SIZE);
+  start = ticks ();
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      pid_t pid = fork ();
+
+      if (pid == 0)
+        exit (child (i));
+      if (pid == PID_ERROR)
+        fail ("fork %d failed", i);
+      if (wait (pid) != i)
+        fail ("child %d saw wrong data", i);
+    }
+  msg ("fork and wait %d children: %d ticks", ITER_CNT, ticks () - start);
+
+  for (ofs = 0; ofs < BUF_SIZE; ofs++)
+    if (buf[ofs] != 0x5a)
+      fail ("byte %zu changed by a child", ofs);
+  msg ("parent data intact");
+
+  start = ticks ();
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      pid_t pid = exec ("child-bench");
+
+      if (pid == PID_ERROR)
+        fail ("exec %d failed", i);
+      if (wait (pid) != 0x2a)
+        fail ("child %d failed", i);
+    }
+  msg ("exec and wait %d children: %d ticks", ITER_CNT, ticks () - start);
+}
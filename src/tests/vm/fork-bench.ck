@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The tick counts vary from run to run, so check them for form
+# and then drop them from the comparison.
+for my $op ('fork', 'exec') {
+    fail "missing $op timing\n"
+      if !grep (/^\(fork-bench\) $op and wait 50 children: \d+ ticks$/,
+		@output);
+}
+@output = grep (!/^\(fork-bench\) \w+ and wait 50 children: \d+ ticks$/,
+		@output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(fork-bench) begin
+(fork-bench) parent data intact
+(fork-bench) end
+EOF
+pass;
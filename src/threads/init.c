@@ -31,11 +31,13 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/page.h"
 #include "vm/swap.h"
 #endif
 
@@ -256,6 +258,15 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fa"))
+        {
+          fault_around_pages = atoi (value);
+          fault_around_report = true;
+        }
+      else if (!strcmp (name, "-zs"))
+        swap_cache_limit = atoi (value) * PGSIZE;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -279,6 +290,22 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints the scheduler trace and latency histograms. */
+static void
+print_sched_trace (char **argv UNUSED)
+{
+  thread_print_sched_trace ();
+}
+
+#ifdef VM
+/* Prints per-process resident sets and fault rates. */
+static void
+print_vm_stats (char **argv UNUSED)
+{
+  frame_print_quotas ();
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -296,6 +323,10 @@ run_actions (char **argv)
   static const struct action actions[] =
     {
       {"run", 2, run_task},
+      {"sched-trace", 1, print_sched_trace},
+#ifdef VM
+      {"vm-stats", 1, print_vm_stats},
+#endif
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -343,6 +374,10 @@ usage (void)
           "  run 'PROG [ARG...]' Run PROG and wait for it to complete.\n"
 #else
           "  run TEST           Run TEST.\n"
+#endif
+          "  sched-trace        Print recent scheduler events and latencies.\n"
+#ifdef VM
+          "  vm-stats           Print resident sets and fault rates.\n"
 #endif
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
@@ -360,6 +395,13 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -fa=COUNT          Map up to COUNT file pages per page fault\n"
+          "                     and report the faults saved at exit.\n"
+          "  -zs=COUNT          Keep up to COUNT pages of compressed swap\n"
+          "                     in memory before writing to the swap disk,\n"
+          "                     which is required.\n"
 #endif
           );
   power_off ();
@@ -398,10 +440,14 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+  cache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  swap_print_stats ();
+#endif
 }
@@ -4,9 +4,11 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -25,9 +27,28 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level, and bit P of
+   ready_bitmap is set exactly when ready_queues[P] is nonempty,
+   so that both enqueueing and picking the highest-priority ready
+   thread take constant time. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static int ready_cnt;           /* # of threads in the run queue. */
+
+/* List of all threads that have not yet exited.  Used by the
+   MLFQS to decay every thread's recent_cpu once per second. */
+static struct list all_list;
+
+/* MLFQS threads whose recent_cpu has grown since their priority
+   was last recomputed, that is, the threads that have run in the
+   last four ticks.  Only these need new priorities on the
+   four-tick boundaries between the per-second updates. */
+static struct list cpu_dirty_list;
+
+/* MLFQS system load average. */
+static fixed_t load_avg;
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -38,6 +59,21 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* LIFO cache of pages freed by dying threads, reused by
+   thread_create() without going back to the page allocator or
+   zeroing the whole page again.  Only touched with interrupts
+   off. */
+#define THREAD_PAGE_CACHE_SIZE 16
+static struct thread *thread_page_cache[THREAD_PAGE_CACHE_SIZE];
+static int thread_page_cache_cnt;
+static long long thread_page_hits;      /* # of pages reused from cache. */
+static long long thread_page_misses;    /* # of pages from palloc. */
+
+/* File descriptors.  0 and 1 are the console, so the fd table
+   hands out descriptors starting from FD_MIN. */
+#define FD_MIN 2
+#define FD_TABLE_INIT 16        /* Initial number of fd table slots. */
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -46,21 +82,52 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-static bool thread_priority_less(const struct list_elem *a,
-    const struct list_elem *b, void *aux) {
-  int priority_a = list_entry(a, struct thread, elem)->priority;
-  int priority_b = list_entry(b, struct thread, elem)->priority;
-
-  return (priority_a > priority_b);
-}
-
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
+static long long skipped_ticks; /* # of idle ticks with no interrupt. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Scheduler trace.  A ring buffer of the most recent
+   SCHED_TRACE_SIZE scheduling events, written only with
+   interrupts off, so it needs no lock. */
+#define SCHED_TRACE_SIZE 256    /* Must be a power of 2. */
+
+enum sched_event_type
+  {
+    SCHED_SWITCH_IN,            /* Thread started running. */
+    SCHED_SWITCH_OUT,           /* Thread stopped running. */
+    SCHED_BLOCK,                /* Thread blocked. */
+    SCHED_UNBLOCK               /* Thread became ready. */
+  };
+
+struct sched_event
+  {
+    int64_t tick;               /* Timer tick of the event. */
+    tid_t tid;                  /* Thread it happened to. */
+    enum sched_event_type type; /* What happened. */
+  };
+
+static struct sched_event sched_trace[SCHED_TRACE_SIZE];
+static unsigned sched_trace_cnt;        /* # of events ever recorded. */
+
+/* A copy of one thread's histograms, made for printing. */
+struct sched_hist_copy
+  {
+    tid_t tid;
+    char name[16];
+    unsigned wait_hist[SCHED_HIST_BUCKETS];
+    unsigned slice_hist[SCHED_HIST_BUCKETS];
+  };
+
+/* Histograms of runnable-to-running latency and of time-slice
+   usage, in timer ticks, over all threads that ever ran. */
+static unsigned sched_wait_hist[SCHED_HIST_BUCKETS];
+static unsigned sched_slice_hist[SCHED_HIST_BUCKETS];
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define DONATION_DEPTH_MAX 8    /* Longest chain of nested donations. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
@@ -79,6 +146,20 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct thread *thread_page_get (void);
+static void thread_page_put (struct thread *);
+static void ready_queue_push (struct thread *);
+static struct thread *ready_queue_pop (void);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_second (bool running);
+static void mlfqs_update_priority (struct thread *);
+static void change_priority (struct thread *, int priority);
+static void refresh_priority (struct thread *);
+static void sched_trace_record (struct thread *, enum sched_event_type);
+static void sched_hist_add (unsigned hist[], int64_t ticks);
+static void sched_hist_print (const char *name, const unsigned hist[]);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -96,11 +177,19 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
   lock_init (&filesys_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_bitmap = 0;
+  ready_cnt = 0;
+  list_init (&all_list);
+  list_init (&cpu_dirty_list);
+  load_avg = 0;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -143,17 +232,155 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    {
+      mlfqs_tick (t);
+      if (ready_queue_max_priority () > t->priority)
+        intr_yield_on_return ();
+    }
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Called by the timer, with interrupts off, to account for
+   SKIPPED ticks that the idle thread spent halted with the
+   periodic timer interrupt stopped. */
+void
+thread_tick_skipped (int64_t skipped)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  idle_ticks += skipped;
+  skipped_ticks += skipped;
+
+  /* Catch up on any once-per-second MLFQS updates that fell
+     within the skipped ticks.  Nothing else was running. */
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+      int64_t seconds = now / TIMER_FREQ - (now - skipped) / TIMER_FREQ;
+
+      while (seconds-- > 0)
+        mlfqs_second (false);
+    }
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld idle ticks skipped without a timer interrupt\n",
+          skipped_ticks);
+  printf ("Thread: %lld of %lld thread pages reused from cache\n",
+          thread_page_hits, thread_page_hits + thread_page_misses);
+  sched_hist_print ("Thread: wait ticks", sched_wait_hist);
+  sched_hist_print ("Thread: slice ticks", sched_slice_hist);
+}
+
+/* Prints the scheduler trace ring buffer, oldest event first,
+   followed by the wait and time-slice histograms of every thread
+   still alive.  Meant to be run when the system is otherwise
+   quiet, e.g. as a kernel action after the tasks of interest.
+   Everything is copied with interrupts off and printed with them
+   on, so printing over the serial port neither holds off the
+   timer nor sees the trace change underneath it. */
+void
+thread_print_sched_trace (void)
+{
+  static const char *type_names[] = {"in", "out", "block", "unblock"};
+  struct sched_event *events;
+  struct sched_hist_copy *threads = NULL;
+  size_t thread_cnt, thread_max = 0;
+  enum intr_level old_level;
+  struct list_elem *e;
+  unsigned cnt, first, i;
+
+  events = malloc (sizeof sched_trace);
+  if (events == NULL)
+    {
+      printf ("Scheduler trace: out of memory\n");
+      return;
+    }
+
+  /* Make room for a copy of every thread's histograms.  Threads
+     may be created while we allocate, so check again with
+     interrupts off. */
+  for (;;)
+    {
+      struct sched_hist_copy *new;
+
+      old_level = intr_disable ();
+      thread_cnt = list_size (&all_list);
+      if (thread_cnt <= thread_max)
+        break;
+      intr_set_level (old_level);
+
+      thread_max = thread_cnt;
+      new = realloc (threads, thread_max * sizeof *threads);
+      if (new == NULL)
+        {
+          printf ("Scheduler trace: out of memory\n");
+          free (threads);
+          free (events);
+          return;
+        }
+      threads = new;
+    }
+
+  /* Take the snapshot. */
+  cnt = sched_trace_cnt;
+  first = cnt > SCHED_TRACE_SIZE ? cnt - SCHED_TRACE_SIZE : 0;
+  for (i = first; i < cnt; i++)
+    events[i - first] = sched_trace[i % SCHED_TRACE_SIZE];
+  thread_cnt = 0;
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      struct sched_hist_copy *c = &threads[thread_cnt++];
+
+      c->tid = t->tid;
+      strlcpy (c->name, t->name, sizeof c->name);
+      memcpy (c->wait_hist, t->wait_hist, sizeof c->wait_hist);
+      memcpy (c->slice_hist, t->slice_hist, sizeof c->slice_hist);
+    }
+  intr_set_level (old_level);
+
+  printf ("Scheduler trace: %u events, last %d kept\n",
+          cnt, SCHED_TRACE_SIZE);
+  for (i = 0; i < cnt - first; i++)
+    printf ("%8lld tid %4d %s\n",
+            events[i].tick, events[i].tid, type_names[events[i].type]);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      printf ("Thread %d (%s):\n", threads[i].tid, threads[i].name);
+      sched_hist_print ("  wait ticks", threads[i].wait_hist);
+      sched_hist_print ("  slice ticks", threads[i].slice_hist);
+    }
+
+  free (threads);
+  free (events);
+}
+
+/* Invokes FUNC on all threads, passing along AUX.
+   This function must be called with interrupts off. */
+void
+thread_foreach (thread_action_func *func, void *aux)
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      func (t, aux);
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -184,7 +411,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -192,6 +419,16 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
+  /* Under the MLFQS, new threads inherit the creator's nice and
+     recent_cpu and ignore the requested priority.  The idle thread
+     keeps PRI_MIN so that it never preempts anyone. */
+  if (thread_mlfqs && function != idle)
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      mlfqs_update_priority (t);
+    }
+
   if (parent != NULL) {
     list_push_front(&parent->child_list, &t->child_elem);
   }
@@ -209,10 +446,14 @@ thread_create (const char *name, int priority,
   /* Stack frame for switch_threads(). */
   sf = alloc_frame (t, sizeof *sf);
   sf->eip = switch_entry;
+  sf->ebp = 0;                  /* Ends backtraces; the page is not zeroed. */
 
   /* Add to run queue. */
   thread_unblock (t);
 
+  /* Preempt ourselves if the new thread should run first. */
+  thread_check_preempt ();
+
   return tid;
 }
 
@@ -228,6 +469,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  sched_trace_record (thread_current (), SCHED_BLOCK);
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -249,8 +491,10 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_insert_ordered (&ready_list, &t->elem, &thread_priority_less, 0);
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  t->ready_tick = timer_ticks ();
+  sched_trace_record (t, SCHED_UNBLOCK);
   intr_set_level (old_level);
 }
 
@@ -301,6 +545,9 @@ thread_exit (void)
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
   intr_disable ();
+  list_remove (&thread_current ()->allelem);
+  if (thread_current ()->cpu_dirty)
+    list_remove (&thread_current ()->dirty_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -318,78 +565,365 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (curr != idle_thread) {
-    list_insert_ordered (&ready_list, &curr->elem, &thread_priority_less, 0);
+    ready_queue_push (curr);
   }
   curr->status = THREAD_READY;
+  curr->ready_tick = timer_ticks ();
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  In an interrupt handler, yields on return
+   from the interrupt instead. */
+void
+thread_check_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (ready_queue_max_priority () > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if some ready thread now has a higher priority.  The
+   thread keeps running at any higher priority donated to it
+   until the donors are gone. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  /* The MLFQS computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  curr->base_priority = new_priority;
+  refresh_priority (curr);
+  intr_set_level (old_level);
+
+  thread_check_preempt ();
+}
+
+/* Donates the running thread's priority to the holder of the lock
+   it is about to wait on, and on down the chain of holders that
+   are themselves waiting on locks, up to DONATION_DEPTH_MAX
+   levels deep.  The running thread must already be in the lock
+   holder's donor list.  Interrupts must be off. */
+void
+thread_donate_priority (void)
+{
+  struct thread *t = thread_current ();
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH_MAX && t->waiting_lock != NULL;
+       depth++)
+    {
+      struct thread *holder = t->waiting_lock->holder;
+
+      if (holder == NULL || holder->priority >= t->priority)
+        break;
+      change_priority (holder, t->priority);
+      t = holder;
+    }
 }
 
+/* Drops the donations that the running thread received from
+   threads waiting on LOCK, which it is about to release.
+   Interrupts must be off. */
+void
+thread_remove_donors (struct lock *lock)
+{
+  struct thread *curr = thread_current ();
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&curr->donors); e != list_end (&curr->donors); )
+    {
+      struct thread *donor = list_entry (e, struct thread, donor_elem);
+
+      if (donor->waiting_lock == lock)
+        e = list_remove (e);
+      else
+        e = list_next (e);
+    }
+  refresh_priority (curr);
+}
+
+/* Installs F in the current thread's fd table at the lowest free
+   descriptor, growing the table if it is full, and returns the
+   descriptor.  Returns -1 if the table cannot grow. */
+int
+thread_add_file (struct file *f) {
+  struct thread *t = thread_current ();
+  int fd;
+
+  for (fd = t->fd_free; fd < t->fd_cnt && t->fd_table[fd] != NULL; fd++)
+    continue;
+
+  if (fd == t->fd_cnt) {
+    int new_cnt = t->fd_cnt > 0 ? t->fd_cnt * 2 : FD_TABLE_INIT;
+    struct file **new_table = realloc (t->fd_table,
+                                       new_cnt * sizeof *new_table);
+    if (new_table == NULL)
+      return -1;
+
+    memset (new_table + t->fd_cnt, 0,
+            (new_cnt - t->fd_cnt) * sizeof *new_table);
+    t->fd_table = new_table;
+    t->fd_cnt = new_cnt;
+  }
+
+  t->fd_table[fd] = f;
+  t->fd_free = fd + 1;
+  return fd;
+}
+
+/* Returns the file open as FD in the current thread, or a null
+   pointer if FD is not open.  The fd table belongs to the thread
+   alone, so no lock is needed. */
 struct file *
 thread_find_file (int fd) {
-  struct list *file_list = &thread_current()->file_list;
-  struct list_elem *curr;
-  struct file *f;
-
-  bool found = false;
-
-  lock_acquire(&filesys_lock);
-  for (curr=list_begin(file_list); curr!=list_tail(file_list);
-      curr=list_next(curr)) {
-    f = list_entry(curr, struct file, elem);
-    if (f->fd == fd) {
-      found = true;
-      break;
-    }
+  struct thread *t = thread_current ();
+
+  if (fd < FD_MIN || fd >= t->fd_cnt)
+    return NULL;
+  return t->fd_table[fd];
+}
+
+/* Removes FD from the current thread's fd table and returns the
+   file that was open there, or a null pointer if FD was not
+   open.  Does not close the file. */
+struct file *
+thread_remove_file (int fd) {
+  struct thread *t = thread_current ();
+  struct file *f = thread_find_file (fd);
+
+  if (f != NULL) {
+    t->fd_table[fd] = NULL;
+    if (fd < t->fd_free)
+      t->fd_free = fd;
   }
+  return f;
+}
+
+/* Gives the current thread its own handle on every file open in
+   PARENT, under the same descriptors and at the same positions,
+   as fork requires.  Returns false if memory runs out; files
+   copied so far stay in the table.  The caller must hold
+   filesys_lock. */
+bool
+thread_copy_files (struct thread *parent) {
+  struct thread *t = thread_current ();
+  int fd;
+
+  if (parent->fd_table == NULL)
+    return true;
+
+  t->fd_table = calloc (parent->fd_cnt, sizeof *t->fd_table);
+  if (t->fd_table == NULL)
+    return false;
+  t->fd_cnt = parent->fd_cnt;
+  t->fd_free = parent->fd_free;
 
-  lock_release(&filesys_lock);
-  return found ? f : NULL;
+  for (fd = FD_MIN; fd < parent->fd_cnt; fd++) {
+    struct file *f = parent->fd_table[fd];
+
+    if (f != NULL) {
+      t->fd_table[fd] = file_reopen (f);
+      if (t->fd_table[fd] == NULL)
+        return false;
+      file_seek (t->fd_table[fd], file_tell (f));
+    }
+  }
+  return true;
 }
 
-/* Returns the current thread's . */
+/* Returns the current thread's priority, including donations. */
 int
 thread_get_priority (void)
 {
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  curr->nice = nice;
+  mlfqs_update_priority (curr);
+  intr_set_level (old_level);
+
+  thread_check_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
+}
+
+/* Per-tick MLFQS accounting for CURR, the running thread.  Runs
+   in the timer interrupt. */
+static void
+mlfqs_tick (struct thread *curr)
+{
+  int64_t now = timer_ticks ();
+
+  if (curr != idle_thread)
+    {
+      curr->recent_cpu = fp_add_int (curr->recent_cpu, 1);
+      if (!curr->cpu_dirty)
+        {
+          curr->cpu_dirty = true;
+          list_push_back (&cpu_dirty_list, &curr->dirty_elem);
+        }
+    }
+
+  if (now % TIMER_FREQ == 0)
+    mlfqs_second (curr != idle_thread);
+
+  /* Only threads that ran since the last update can have a new
+     priority, so there is no need to look at any other thread. */
+  if (now % 4 == 0)
+    while (!list_empty (&cpu_dirty_list))
+      {
+        struct list_elem *e = list_pop_front (&cpu_dirty_list);
+        struct thread *t = list_entry (e, struct thread, dirty_elem);
+
+        t->cpu_dirty = false;
+        mlfqs_update_priority (t);
+      }
+}
+
+/* Once-per-second MLFQS update: recomputes the load average,
+   given whether a thread other than the idle thread is RUNNING,
+   then decays every thread's recent_cpu, recomputing priorities
+   only where recent_cpu actually changed.  Interrupts must be
+   off. */
+static void
+mlfqs_second (bool running)
+{
+  struct list_elem *e;
+  fixed_t coefficient;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  load_avg = (59 * load_avg + fp_from_int (ready_cnt + running)) / 60;
+  coefficient = fp_div (2 * load_avg, fp_add_int (2 * load_avg, 1));
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      fixed_t recent_cpu;
+
+      if (t == idle_thread)
+        continue;
+
+      recent_cpu = fp_add_int (fp_mul (coefficient, t->recent_cpu), t->nice);
+      if (recent_cpu != t->recent_cpu)
+        {
+          t->recent_cpu = recent_cpu;
+          mlfqs_update_priority (t);
+        }
+    }
+}
+
+/* Recomputes T's MLFQS priority from its recent_cpu and nice
+   values, moving it to the right run queue if it is ready. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  change_priority (t, priority);
+}
+
+/* Sets T's effective priority to PRIORITY, moving it to the right
+   run queue if it is ready. */
+static void
+change_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  if (priority == t->priority)
+    return;
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
+  intr_set_level (old_level);
+}
+
+/* Recomputes T's effective priority as the highest of its base
+   priority and the priorities of the threads donating to it. */
+static void
+refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  for (e = list_begin (&t->donors); e != list_end (&t->donors);
+       e = list_next (e))
+    {
+      struct thread *donor = list_entry (e, struct thread, donor_elem);
+      if (donor->priority > priority)
+        priority = donor->priority;
+    }
+  change_priority (t, priority);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -410,10 +944,15 @@ idle (void *idle_started_ UNUSED)
 
   for (;;)
     {
-      /* Let someone else run. */
+      /* Let someone else run.  schedule() catches up on any
+         ticks missed while we were halted. */
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is ready, so there is no need for a timer
+         interrupt until the next sleeper is due. */
+      timer_tickless_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -467,6 +1006,8 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -476,13 +1017,25 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  t->waiting_lock = NULL;
+  list_init (&t->donors);
   t->alarm_ticks = -1;
   t->magic = THREAD_MAGIC;
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
+  t->cpu_dirty = false;
   t->self_file = NULL;
   list_init(&t->child_list);
-  list_init(&t->file_list);
+  t->fd_table = NULL;
+  t->fd_cnt = 0;
+  t->fd_free = FD_MIN;
   sema_init(&t->exit_sema, 0);
   sema_init(&t->wait_sema, 0);
+
+  old_level = intr_disable ();
+  list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -506,10 +1059,77 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  if (ready_bitmap == 0)
     return idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return ready_queue_pop ();
+}
+
+/* Appends T to the back of the run queue for its priority, so
+   that threads of equal priority are scheduled round-robin.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes and returns the frontmost thread of the highest
+   nonempty priority level.  The run queue must not be empty and
+   interrupts must be off. */
+static struct thread *
+ready_queue_pop (void)
+{
+  int priority = ready_queue_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (priority >= PRI_MIN);
+
+  queue = &ready_queues[priority];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_bitmap &= ~((uint64_t) 1 << priority);
+  ready_cnt--;
+  return t;
+}
+
+/* Removes ready thread T from the run queue, wherever it is.
+   Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bitmap &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Returns the highest priority that has a ready thread, or
+   PRI_MIN - 1 if the run queue is empty.  The bitmap is scanned
+   as two 32-bit halves because the target has no 64-bit bit
+   scan instruction. */
+static int
+ready_queue_max_priority (void)
+{
+  uint32_t high = ready_bitmap >> 32;
+  uint32_t low = ready_bitmap;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return PRI_MIN - 1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -554,7 +1174,7 @@ schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != curr);
-      palloc_free_page (prev);
+      thread_page_put (prev);
     }
 }
 
@@ -569,18 +1189,137 @@ static void
 schedule (void)
 {
   struct thread *curr = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (curr->status != THREAD_RUNNING);
+
+  /* Leaving a tickless halt: restore the periodic tick and catch
+     up on the ticks it skipped before anything reads the clock.
+     The idle thread gets here from thread_block() in idle(), but
+     also from thread_yield() when an interrupt handler wakes a
+     thread and asks to preempt it. */
+  if (curr == idle_thread)
+    timer_tickless_exit ();
+
+  next = next_thread_to_run ();
   ASSERT (is_thread (next));
 
   if (curr != next)
-    prev = switch_threads (curr, next);
+    {
+      int64_t now = timer_ticks ();
+
+      if (curr != idle_thread)
+        {
+          sched_hist_add (curr->slice_hist, now - curr->run_tick);
+          sched_hist_add (sched_slice_hist, now - curr->run_tick);
+        }
+      if (next != idle_thread)
+        {
+          sched_hist_add (next->wait_hist, now - next->ready_tick);
+          sched_hist_add (sched_wait_hist, now - next->ready_tick);
+        }
+      next->run_tick = now;
+      sched_trace_record (curr, SCHED_SWITCH_OUT);
+      sched_trace_record (next, SCHED_SWITCH_IN);
+
+      prev = switch_threads (curr, next);
+    }
   schedule_tail (prev);
 }
 
+/* Appends an event of the given TYPE for thread T to the
+   scheduler trace, overwriting the oldest event once the ring
+   buffer is full.  Interrupts must be off. */
+static void
+sched_trace_record (struct thread *t, enum sched_event_type type)
+{
+  struct sched_event *ev;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ev = &sched_trace[sched_trace_cnt++ % SCHED_TRACE_SIZE];
+  ev->tick = timer_ticks ();
+  ev->tid = t->tid;
+  ev->type = type;
+}
+
+/* Counts TICKS in histogram HIST.  Bucket 0 counts zero ticks,
+   bucket B > 0 counts 2**(B-1) to 2**B - 1 ticks, and the last
+   bucket also counts everything longer. */
+static void
+sched_hist_add (unsigned hist[], int64_t ticks)
+{
+  int bucket = 0;
+
+  while (ticks > 0 && bucket < SCHED_HIST_BUCKETS - 1)
+    {
+      ticks >>= 1;
+      bucket++;
+    }
+  hist[bucket]++;
+}
+
+/* Prints histogram HIST on one line, preceded by NAME. */
+static void
+sched_hist_print (const char *name, const unsigned hist[])
+{
+  int bucket;
+
+  printf ("%s:", name);
+  for (bucket = 0; bucket < SCHED_HIST_BUCKETS; bucket++)
+    if (bucket == 0)
+      printf (" 0:%u", hist[bucket]);
+    else if (bucket == SCHED_HIST_BUCKETS - 1)
+      printf (" %d+:%u", 1 << (bucket - 1), hist[bucket]);
+    else
+      printf (" %d-%d:%u", 1 << (bucket - 1), (1 << bucket) - 1, hist[bucket]);
+  printf ("\n");
+}
+
+/* Returns a page for a new thread, preferably one recently freed
+   by a dying thread, or a null pointer if none is available.
+   Only the `struct thread' at the bottom of the page needs to be
+   zeroed, which init_thread() does, and thread_create() writes
+   every stack frame word that is read, so neither a cached page
+   nor a fresh one is zeroed here. */
+static struct thread *
+thread_page_get (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (thread_page_cache_cnt > 0)
+    {
+      t = thread_page_cache[--thread_page_cache_cnt];
+      thread_page_hits++;
+    }
+  else
+    thread_page_misses++;
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (0);
+  return t;
+}
+
+/* Releases T, the page of a dead thread, into the thread page
+   cache, or back to the page allocator if the cache is full.
+   Interrupts must be off. */
+static void
+thread_page_put (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->magic = 0;
+  if (thread_page_cache_cnt < THREAD_PAGE_CACHE_SIZE)
+    thread_page_cache[thread_page_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
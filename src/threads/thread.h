@@ -2,6 +2,8 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <fixed-point.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
@@ -26,6 +28,14 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Number of buckets in the scheduler latency histograms. */
+#define SCHED_HIST_BUCKETS 8
+
+/* Thread nice values, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -89,11 +99,28 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority before donations. */
     int64_t alarm_ticks;                /* Remaining timer ticks */
+    struct list_elem allelem;           /* List element for all threads list. */
+
+    /* Owned by thread.c, for the MLFQS. */
+    int nice;                           /* Nice value. */
+    fixed_t recent_cpu;                 /* Recent CPU time, decayed. */
+    bool cpu_dirty;                     /* In cpu_dirty_list? */
+    struct list_elem dirty_elem;        /* Element in cpu_dirty_list. */
+
+    /* Owned by thread.c, for the scheduler trace. */
+    int64_t ready_tick;                 /* Tick it last became ready. */
+    int64_t run_tick;                   /* Tick it last started running. */
+    unsigned wait_hist[SCHED_HIST_BUCKETS];  /* Ready-to-running ticks. */
+    unsigned slice_hist[SCHED_HIST_BUCKETS]; /* Ticks run per switch. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct lock *waiting_lock;          /* Lock being waited on, if any. */
+    struct list donors;                 /* Threads waiting on our locks. */
+    struct list_elem donor_elem;        /* Element in holder's donors. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -106,7 +133,28 @@ struct thread
     struct file *self_file;             /* User process executable file */
 #endif
 
-    struct list file_list;              /* List of open files for this thread */
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash s_page_table;           /* Supplemental page table. */
+    struct lock s_page_lock;            /* Guards s_page_table. */
+    struct list mmap_list;              /* Memory-mapped files. */
+    int next_mapid;                     /* Mapid for the next mmap. */
+    int faults_saved;                   /* Pages mapped by fault-around. */
+
+    /* Owned by vm/frame.c. */
+    int rss;                            /* Pages mapped to frames. */
+    int rss_peak;                       /* Largest RSS so far. */
+    int rss_target;                     /* Resident-set target. */
+    int ws_size;                        /* Pages used in last window. */
+    int ws_sampled;                     /* Pages used in this window. */
+    int fault_cnt;                      /* Faults in this window. */
+    int fault_rate;                     /* Faults per window, lately. */
+    int64_t pff_tick;                   /* Start of this window. */
+#endif
+
+    struct file **fd_table;             /* Open files, indexed by fd */
+    int fd_cnt;                         /* Number of slots in fd_table */
+    int fd_free;                        /* No free fd below this one */
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -122,7 +170,9 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_skipped (int64_t skipped);
 void thread_print_stats (void);
+void thread_print_sched_trace (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *,
@@ -135,10 +185,21 @@ struct thread *thread_current (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
+int thread_add_file (struct file *);
 struct file *thread_find_file (int);
+struct file *thread_remove_file (int);
+bool thread_copy_files (struct thread *);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_check_preempt (void);
+
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, void *);
+
+void thread_donate_priority (void);
+void thread_remove_donors (struct lock *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
@@ -159,7 +159,9 @@ page_fault (struct intr_frame *f)
 
   if (page != NULL) {
     if (not_present) {
-      success = s_page_load (page);
+      success = s_page_load (page, write);
+    } else if (write && page->writable) {
+      success = s_page_unshare (page);
     } else if (write) {
       if (lock_held_by_current_thread (&filesys_lock)) {
         lock_release (&filesys_lock);
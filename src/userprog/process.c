@@ -15,6 +15,7 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -24,7 +25,17 @@
 static struct semaphore load_sema;
 static struct semaphore success_sema;
 
+/* Handed from fork's caller to the new child process. */
+struct fork_info
+  {
+    struct thread *parent;              /* Forking process. */
+    struct intr_frame if_;              /* Parent's user context. */
+    struct semaphore done;              /* Upped when the copy is done. */
+    bool success;                       /* Whether the copy worked. */
+  };
+
 static thread_func start_process NO_RETURN;
+static thread_func fork_process NO_RETURN;
 static bool load (char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -73,8 +84,6 @@ start_process (void *fn_copy)
   bool success;
   char *file_name = (char *) fn_copy;
 
-  s_page_init();
-
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -97,6 +106,77 @@ start_process (void *fn_copy)
   NOT_REACHED ();
 }
 
+/* Creates a child of the current process that resumes from the
+   system call in F with its own copy of our address space and
+   open files, and returns its thread id, or TID_ERROR if it could
+   not be created.  Memory is not copied: both processes share
+   their resident pages copy-on-write. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct thread *curr = thread_current ();
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = curr;
+  info.if_ = *f;
+  sema_init (&info.done, 0);
+  info.success = false;
+
+  tid = thread_create (curr->name, PRI_DEFAULT, fork_process, &info, curr);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  sema_down (&info.done);
+  return info.success ? tid : TID_ERROR;
+}
+
+/* A thread function that copies the forking process described
+   by INFO_ and returns to user mode with fork returning 0. */
+static void
+fork_process (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL)
+    {
+      s_page_init ();
+      process_activate ();
+
+      lock_acquire (&filesys_lock);
+      t->self_file = file_reopen (parent->self_file);
+      if (t->self_file != NULL)
+        {
+          file_deny_write (t->self_file);
+          success = thread_copy_files (parent);
+        }
+      lock_release (&filesys_lock);
+
+      if (success)
+        success = s_page_fork (parent);
+    }
+
+  /* INFO lives on the parent's stack, which may be gone as soon
+     as we signal it. */
+  info->success = success;
+  if (!success)
+    {
+      list_remove (&t->child_elem);
+      sema_up (&info->done);
+      thread_exit ();
+    }
+  sema_up (&info->done);
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -141,6 +221,31 @@ process_exit (void)
 {
   struct thread *curr = thread_current ();
   uint32_t *pd;
+  int fd;
+
+  /* Close every file the process left open. */
+  if (curr->fd_table != NULL) {
+    lock_acquire(&filesys_lock);
+    for (fd = 0; fd < curr->fd_cnt; fd++) {
+      file_close(thread_remove_file(fd));
+    }
+    lock_release(&filesys_lock);
+    free(curr->fd_table);
+    curr->fd_table = NULL;
+    curr->fd_cnt = 0;
+  }
+
+  /* Give back the process's user pages while its page directory
+     and executable are still around, since shared text frames are
+     keyed by the executable's inode. */
+  if (curr->pagedir != NULL) {
+#ifdef VM
+    if (fault_around_report)
+      printf ("%s: %d page faults saved by fault-around\n",
+              curr->name, curr->faults_saved);
+#endif
+    s_page_destroy ();
+  }
 
   if (curr->self_file != NULL) {
     lock_acquire(&filesys_lock);
@@ -273,6 +378,7 @@ load (char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
     goto done;
+  s_page_init ();
   process_activate ();
 
 
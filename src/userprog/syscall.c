@@ -2,6 +2,7 @@
 #include "userprog/process.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -13,10 +14,16 @@
 #include "vm/page.h"
 
 static bool check_uaddr (void *);
+static bool check_ubuf (const void *, size_t);
+static bool check_ustr (const char *);
 
 static void syscall_handler (struct intr_frame *);
 static void get_user (const uint8_t *uaddr, void *save_to, size_t size);
 static void put_user (const uint8_t *uaddr, void *copy_from, size_t size);
+static int file_io (struct file *, void *, unsigned, bool, void *);
+
+/* Most pages of a user buffer pinned at once by file_io. */
+#define IO_CHUNK_PAGES 16
 
 typedef void (*handler) (void *, uint32_t *, uint32_t *);
 
@@ -33,8 +40,10 @@ static void write (void **argv, uint32_t *eax, uint32_t *esp);
 static void seek (void **argv, uint32_t *eax, uint32_t *esp);
 static void tell (void **argv, uint32_t *eax, uint32_t *esp);
 static void close (void **argv, uint32_t *eax, uint32_t *esp);
+static void mmap (void **argv, uint32_t *eax, uint32_t *esp);
+static void munmap (void **argv, uint32_t *eax, uint32_t *esp);
 
-static handler handlers[13] = {
+static handler handlers[15] = {
   &halt,
   &exit,
   &exec,
@@ -47,7 +56,9 @@ static handler handlers[13] = {
   &write,
   &seek,
   &tell,
-  &close
+  &close,
+  &mmap,
+  &munmap
 };
 
 /* Check and if UADDR is invalid address, return true
@@ -58,13 +69,62 @@ check_uaddr (void *uaddr) {
     return true;
   }
 
-  if (!pagedir_get_page(thread_current()->pagedir, uaddr)) {
+  /* A page that is swapped out or not yet loaded is still valid;
+     touching it faults it back in. */
+  if (!pagedir_get_page(thread_current()->pagedir, uaddr)
+      && page_lookup(uaddr) == NULL) {
+    return true;
+  }
+
+  return false;
+}
+
+/* Check and if any byte of the SIZE bytes at UADDR is invalid,
+   return true.  Validity is per page, so only one address in each
+   page is looked up; pages not loaded yet are faulted in when the
+   kernel touches them.  Return false otherwise */
+static bool
+check_ubuf (const void *uaddr, size_t size) {
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (size == 0) {
+    return false;
+  }
+  if (end < p || !is_user_vaddr(end - 1)) {
     return true;
   }
 
+  for (; p < end; p = pg_round_down(p) + PGSIZE) {
+    if (check_uaddr((void *) p)) {
+      return true;
+    }
+  }
+
   return false;
 }
 
+/* Check and if the null-terminated string at USTR runs into an
+   invalid address, return true.  Looks up one address per page
+   the string touches.  Return false otherwise */
+static bool
+check_ustr (const char *ustr) {
+  const char *p = ustr;
+
+  for (;;) {
+    const char *page_end = (const char *) pg_round_down(p) + PGSIZE;
+
+    if (check_uaddr((void *) p)) {
+      return true;
+    }
+    for (; p < page_end; p++) {
+      if (*p == '\0') {
+        return false;
+      }
+    }
+  }
+}
+
 void
 syscall_init (void)
 {
@@ -104,16 +164,25 @@ syscall_handler (struct intr_frame *f)
     case SYS_FILESIZE:
     case SYS_TELL:
     case SYS_CLOSE:
+    case SYS_MUNMAP:
       argc = 1;
       break;
     case SYS_CREATE:
     case SYS_SEEK:
+    case SYS_MMAP:
       argc = 2;
       break;
     case SYS_READ:
     case SYS_WRITE:
       argc = 3;
       break;
+    case SYS_FORK:
+      /* The child needs the whole interrupt frame to return to. */
+      *eax = process_fork (f);
+      return;
+    case SYS_TICKS:
+      *eax = timer_ticks ();
+      return;
     default:
       printf("Unavailable system call for now\n");
       return;
@@ -130,31 +199,24 @@ syscall_handler (struct intr_frame *f)
 }
 
 /* Reads SIZE bytes at user virtual address UADDR.
-   Power off if failed. */
+   Exit the process if failed. */
 static void
 get_user (const uint8_t *uaddr, void *save_to, size_t size)
 {
-  uint8_t *check = uaddr;
-  for (check; check < uaddr + size; check++) {
-    if (check_uaddr(check)) {
-      abnormal_exit();
-    }
+  if (check_ubuf(uaddr, size)) {
+    abnormal_exit();
   }
 
-
   memcpy (save_to, uaddr, size);
 }
 
 /* Writes SIZE bytes to user address UADDR, copying from COPY_FROM.
-   Power off if failed. */
+   Exit the process if failed. */
 static void
 put_user (const uint8_t *uaddr, void *copy_from, size_t size)
 {
-  uint8_t *check = uaddr;
-  for (check; check < uaddr + size; check++) {
-    if (check_uaddr(check)) {
-      abnormal_exit();
-    }
+  if (check_ubuf(uaddr, size)) {
+    abnormal_exit();
   }
 
   memcpy (uaddr, copy_from, size);
@@ -187,7 +249,7 @@ exec (void **argv, uint32_t *eax, uint32_t *esp) {
   char *cmd_line = (char *) argv[0];
   char *exec_cmd_line;
 
-  if (check_uaddr(cmd_line)) {
+  if (check_ustr(cmd_line)) {
     abnormal_exit();
   }
 
@@ -211,7 +273,7 @@ create (void **argv, uint32_t *eax, uint32_t *esp) {
   char *file = (char *) argv[0];
   unsigned initial_size = (unsigned) argv[1];
 
-  if (check_uaddr(file)) {
+  if (check_ustr(file)) {
     abnormal_exit();
   }
 
@@ -225,7 +287,7 @@ static void
 remove (void **argv, uint32_t *eax, uint32_t *esp) {
   char *name = (char *) argv[0];
 
-  if (check_uaddr(name)) {
+  if (check_ustr(name)) {
     abnormal_exit();
   }
 
@@ -239,24 +301,27 @@ static void
 open (void **argv, uint32_t *eax, uint32_t *esp) {
   char *cmd_name = (char *) argv[0];
 
-  if (check_uaddr(cmd_name)) {
+  if (check_ustr(cmd_name)) {
     abnormal_exit();
   }
 
   char *name = palloc_get_page(0);
   struct file *f;
+  int fd = -1;
 
   strlcpy (name, cmd_name, PGSIZE);
 
   lock_acquire(&filesys_lock);
   f = filesys_open (name);
+  if (f != NULL) {
+    fd = thread_add_file (f);
+    if (fd == -1) {
+      file_close (f);
+    }
+  }
   lock_release(&filesys_lock);
 
-  if (!f) {
-    *eax = -1;
-  } else {
-    *eax = (f->fd);
-  }
+  *eax = fd;
   palloc_free_page (name);
   return;
 }
@@ -300,28 +365,13 @@ read (void **argv, uint32_t *eax, uint32_t *esp) {
     abnormal_exit();
   }
 
-  if (is_stack_access ((unsigned) buffer + size, esp)) {
-    grow_stack ((unsigned) buffer + size);
-
-    if (is_stack_access (buffer, esp-PGSIZE)) {
-      grow_stack (buffer);
-    }
-  }
-
-  if (check_uaddr(buffer)) {
-    abnormal_exit();
-  }
-
   f = thread_find_file(fd);
 
   if (!f) {
     abnormal_exit();
   }
 
-  lock_acquire(&filesys_lock);
-  *eax = file_read(f, buffer, size);
-  lock_release(&filesys_lock);
-
+  *eax = file_io(f, buffer, size, true, esp);
   return;
 }
 
@@ -330,39 +380,67 @@ write (void **argv, uint32_t *eax, uint32_t *esp) {
   int fd = (int) argv[0];
   char *buf = (char *)argv[1];
   unsigned size = (unsigned )argv[2];
-  struct file *f;
-
-  if (is_stack_access ((unsigned) buf + size, esp)) {
-    grow_stack ((unsigned) buf + size);
-    if (is_stack_access (buf, esp-PGSIZE)) {
-      grow_stack (buf);
-    }
-  }
-
-  if (check_uaddr(buf)) {
-    abnormal_exit();
-  }
+  struct file *f = NULL;
 
   if (fd == 0) {
     abnormal_exit();
   }
 
-  if (fd == 1) {
-    putbuf(buf, size);
-    return;
+  if (fd != 1) {
+    f = thread_find_file(fd);
+
+    if (!f) {
+      abnormal_exit();
+    }
   }
 
-  f = thread_find_file(fd);
+  *eax = file_io(f, buf, size, false, esp);
+  return;
+}
 
-  if (!f) {
-    abnormal_exit();
-  }
+/* Reads SIZE bytes from F into user buffer BUF if TO_USER,
+   otherwise writes SIZE bytes of BUF to F, or to the console if F
+   is null.  The buffer is faulted in and pinned a chunk at a time
+   before filesys_lock is taken, so the I/O never page-faults while
+   holding the lock and a buffer of any size fits in memory.
+   Returns the number of bytes transferred.  Exit the process if
+   BUF is invalid. */
+static int
+file_io (struct file *f, void *buf, unsigned size, bool to_user,
+    void *esp) {
+  unsigned done = 0;
+
+  while (done < size) {
+    uint8_t *chunk = (uint8_t *) buf + done;
+    unsigned chunk_size = (uint8_t *) pg_round_down(chunk)
+        + IO_CHUNK_PAGES * PGSIZE - chunk;
+    int n;
+
+    if (chunk_size > size - done) {
+      chunk_size = size - done;
+    }
+    if (!s_page_pin_range(chunk, chunk_size, to_user, esp)) {
+      abnormal_exit();
+    }
 
-  lock_acquire(&filesys_lock);
-  *eax = file_write(f, buf, size);
-  lock_release(&filesys_lock);
+    if (f == NULL) {
+      putbuf((const char *) chunk, chunk_size);
+      n = chunk_size;
+    } else {
+      lock_acquire(&filesys_lock);
+      n = to_user ? file_read(f, chunk, chunk_size)
+                  : file_write(f, chunk, chunk_size);
+      lock_release(&filesys_lock);
+    }
+    s_page_unpin_range(chunk, chunk_size);
 
-  return;
+    done += n;
+    if ((unsigned) n < chunk_size) {
+      break;
+    }
+  }
+
+  return done;
 }
 
 static void
@@ -394,11 +472,7 @@ close (void **argv, uint32_t *eax, uint32_t *esp) {
   int fd = (int) argv[0];
   struct file *f;
 
-  if (fd < 2) {
-    abnormal_exit();
-  }
-
-  f = thread_find_file(fd);
+  f = thread_remove_file(fd);
 
   if (!f) {
     abnormal_exit();
@@ -410,3 +484,26 @@ close (void **argv, uint32_t *eax, uint32_t *esp) {
 
   return;
 }
+
+static void
+mmap (void **argv, uint32_t *eax, uint32_t *esp) {
+  int fd = (int) argv[0];
+  uint8_t *addr = (uint8_t *) argv[1];
+  struct file *f = thread_find_file(fd);
+
+  if (!f) {
+    *eax = -1;
+    return;
+  }
+
+  *eax = s_page_mmap (f, addr);
+  return;
+}
+
+static void
+munmap (void **argv, uint32_t *eax, uint32_t *esp) {
+  int mapid = (int) argv[0];
+
+  s_page_munmap (mapid);
+  return;
+}
@@ -1,45 +1,355 @@
 #include "vm/frame.h"
-#include "threads/malloc.h"
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 
+/* One descriptor per user pool page. */
+static struct frame *frame_table;
+static size_t frame_cnt;
+static uint8_t *frame_base;
+static struct lock frame_lock;
+static size_t clock_hand;               /* Next frame the clock looks at. */
+
+/* Shared text frames, keyed by inode and offset. */
+static struct hash share_table;
+
+/* A page of zeros, mapped read-only by every ZERO page that has
+   only been read so far.  Pinned for good, so never evicted or
+   freed.  Null if the user pool had no page to spare. */
+static struct frame *zero_frame;
+
+/* Page-fault-frequency quotas.  Every process has a resident-set
+   target.  Its faults are counted over windows of PFF_WINDOW
+   ticks: above PFF_HIGH faults per window the target grows by a
+   quarter, below PFF_LOW it shrinks by an eighth, but never
+   below RSS_TARGET_MIN or the number of pages the clock saw the
+   process use during the last window.  The evictor takes frames
+   from processes over their target before anyone else's. */
+#define PFF_WINDOW (TIMER_FREQ / 10)
+#define PFF_HIGH 8
+#define PFF_LOW 2
+#define RSS_TARGET_MIN 16
+#define RSS_TARGET_INIT 64
+
+/* Quotas of the last few processes to exit, for vm-stats. */
+#define QUOTA_HISTORY 8
+struct quota_record {
+  tid_t tid;
+  char name[16];
+  int rss_peak;
+  int rss_target;
+  int fault_rate;
+};
+static struct quota_record quota_history[QUOTA_HISTORY];
+static unsigned quota_exit_cnt;
+
+static struct frame *frame_slot (uint8_t *);
+static uint8_t *frame_get (struct s_page *, bool evict);
+static void frame_map (struct frame *, struct s_page *);
+static void frame_unlink (struct frame *, struct s_page *);
+static void frame_clear (struct frame *);
+static void frame_release (struct frame *);
+static bool frame_accessed (struct frame *);
+static void frame_remap (struct frame *);
+static bool frame_page_out (struct frame *);
+static uint8_t *frame_evict (void);
+static void quota_update (struct thread *);
+static bool quota_exceeded (struct frame *);
+static void quota_print (struct thread *, void *);
+static unsigned share_hash (const struct hash_elem *, void *);
+static bool share_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+
+/* Allocates the frame table to cover the whole user pool. */
 void
 frame_init () {
-  list_init (&frame_table);
+  uint8_t *zero_page;
+  size_t i;
+
+  frame_base = palloc_user_base ();
+  frame_cnt = palloc_user_page_cnt ();
+  frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+      DIV_ROUND_UP (frame_cnt * sizeof *frame_table, PGSIZE));
+  for (i = 0; i < frame_cnt; i++)
+    list_init (&frame_table[i].pages);
+  hash_init (&share_table, &share_hash, &share_less, NULL);
   lock_init (&frame_lock);
+
+  zero_page = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (zero_page != NULL) {
+    zero_frame = frame_slot (zero_page);
+    zero_frame->kpage = zero_page;
+    zero_frame->pin_cnt = 1;
+  }
 }
 
+/* Returns a frame for PAGE, evicting another page if the user
+   pool is exhausted, and records PAGE as mapped to it.  The frame
+   comes back pinned, so that it is not evicted before the caller
+   has filled and installed it; the caller unpins it.  Returns a
+   null pointer if no frame can be found or freed. */
 uint8_t *
-frame_alloc (uint8_t *upage) {
-  struct frame *f;
-  uint8_t *kpage = palloc_get_page (PAL_USER);
+frame_alloc (struct s_page *page) {
+  return frame_get (page, true);
+}
 
-  if (kpage != NULL) {
-    f = malloc (sizeof (struct frame));
+/* Like frame_alloc, but only takes a free frame and never
+   evicts, for speculative loads. */
+uint8_t *
+frame_try_alloc (struct s_page *page) {
+  return frame_get (page, false);
+}
 
-    f->kpage = kpage;
-    f->upage = upage;
-    f->owner = thread_current();
-    f->pinned = false;
+/* If the file page of INODE at OFS with READ_BYTES bytes of data
+   is already resident in a shared frame, records PAGE as mapped
+   to it and returns it, pinned.  Otherwise returns a null
+   pointer. */
+uint8_t *
+frame_share_get (struct s_page *page, struct inode *inode, off_t ofs,
+    uint32_t read_bytes) {
+  struct frame key;
+  struct frame *f = NULL;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
 
-    list_push_front (&frame_table, &f->elem);
+  lock_acquire (&frame_lock);
+  e = hash_find (&share_table, &key.share_elem);
+  if (e != NULL) {
+    f = hash_entry (e, struct frame, share_elem);
+    f->pin_cnt++;
+    frame_map (f, page);
   }
+  lock_release (&frame_lock);
+
+  return f != NULL ? f->kpage : NULL;
+}
+
+/* Records ZERO page PAGE as mapped to the shared zero frame and
+   returns the frame, pinned.  The caller must map it read-only.
+   Returns a null pointer if there is no zero frame or PAGE is no
+   longer a ZERO page. */
+uint8_t *
+frame_zero_get (struct s_page *page) {
+  uint8_t *kpage = NULL;
+
+  lock_acquire (&frame_lock);
+  if (zero_frame != NULL && page->location == ZERO) {
+    zero_frame->pin_cnt++;
+    frame_map (zero_frame, page);
+    kpage = zero_frame->kpage;
+  }
+  lock_release (&frame_lock);
 
   return kpage;
 }
 
+/* Offers frame KPAGE, just loaded from INODE at OFS, to other
+   processes running the same binary.  Does nothing if another
+   frame already holds that page. */
 void
-frame_free (uint8_t *kpage) {
-  bool found = false;
+frame_share_put (uint8_t *kpage, struct inode *inode, off_t ofs,
+    uint32_t read_bytes) {
   struct frame *f = frame_find (kpage);
 
-  if (f != NULL) {
-    palloc_free_page (kpage);
-    list_remove (&f->elem);
-  } else {
-    printf ("Trying to free not allocated frame.\n");
-    abnormal_exit ();
+  ASSERT (f != NULL);
+
+  lock_acquire (&frame_lock);
+  f->inode = inode;
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
+  if (hash_insert (&share_table, &f->share_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Removes PAGE from its owner's page directory and from the frame
+   it is mapped to, freeing the frame once no page maps it.  Does
+   nothing if PAGE is not resident. */
+void
+frame_unmap (struct s_page *page) {
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  if (page->kpage != NULL) {
+    f = frame_slot (page->kpage);
+
+    pagedir_clear_page (page->owner->pagedir, page->uaddr);
+    frame_unlink (f, page);
+    frame_release (f);
+  }
+  lock_release (&frame_lock);
+}
+
+/* Makes CHILD, the copy of PARENT made by fork in the current
+   process, start out with PARENT's contents.  If PARENT is
+   resident, the two share its frame, mapped read-only in both
+   processes until one of them writes to it; otherwise CHILD takes
+   a reference to PARENT's swap slot, if any.  Runs under
+   frame_lock, so eviction cannot move PARENT halfway through.
+   Returns false if CHILD's mapping cannot be installed. */
+bool
+frame_fork (struct s_page *parent, struct s_page *child) {
+  bool success = true;
+
+  lock_acquire (&frame_lock);
+  child->location = parent->location;
+  child->swap_slot = parent->swap_slot;
+  if (parent->kpage != NULL) {
+    struct frame *f = frame_slot (parent->kpage);
+    uint32_t *parent_pd = parent->owner->pagedir;
+    uint32_t *child_pd = child->owner->pagedir;
+
+    success = pagedir_set_page (child_pd, child->uaddr, f->kpage, false);
+    if (success) {
+      /* A dirty frame differs from the pages' source, which every
+         sharer must know in case the others drop out first. */
+      if (pagedir_is_dirty (parent_pd, parent->uaddr))
+        pagedir_set_dirty (child_pd, child->uaddr, true);
+      pagedir_set_writable (parent_pd, parent->uaddr, false);
+      frame_map (f, child);
+    }
+  } else if (child->location == SWAP && child->swap_slot != SWAP_ERROR)
+    swap_dup (child->swap_slot);
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Handles a write fault by PAGE on a frame it shares
+   copy-on-write, or on the zero frame.  The last page left on a
+   shared frame just has its mapping made writable; any other
+   gets a private copy.  Returns
+   false if no frame is left for the copy. */
+bool
+frame_unshare (struct s_page *page) {
+  uint32_t *pd = page->owner->pagedir;
+  struct frame *old;
+  uint8_t *kpage;
+  bool success = false;
+
+  lock_acquire (&frame_lock);
+  if (page->kpage == NULL) {
+    /* Evicted since the fault; retrying faults it back in. */
+    lock_release (&frame_lock);
+    return true;
+  }
+  old = frame_slot (page->kpage);
+  if (old->ref_cnt == 1 && old != zero_frame) {
+    pagedir_set_writable (pd, page->uaddr, true);
+    lock_release (&frame_lock);
+    return true;
+  }
+
+  /* Leave the shared frame, keeping it pinned while we copy. */
+  old->pin_cnt++;
+  pagedir_clear_page (pd, page->uaddr);
+  frame_unlink (old, page);
+  lock_release (&frame_lock);
+
+  kpage = frame_alloc (page);
+  if (kpage != NULL) {
+    memcpy (kpage, old->kpage, PGSIZE);
+    success = pagedir_set_page (pd, page->uaddr, kpage, true);
+    if (success)
+      pagedir_set_dirty (pd, page->uaddr, true);
+    frame_unpin (kpage);
+    if (!success)
+      frame_unmap (page);
   }
+  frame_unpin (old->kpage);
+
+  return success;
+}
+
+/* Starts T, a new process, at the initial resident-set
+   target. */
+void
+frame_quota_init (struct thread *t) {
+  t->rss = 0;
+  t->rss_peak = 0;
+  t->rss_target = RSS_TARGET_INIT;
+  if (frame_cnt != 0 && (size_t) t->rss_target > frame_cnt)
+    t->rss_target = frame_cnt;
+  t->ws_size = 0;
+  t->ws_sampled = 0;
+  t->fault_cnt = 0;
+  t->fault_rate = 0;
+  t->pff_tick = timer_ticks ();
+}
+
+/* Records the quota of T, which is exiting, for vm-stats. */
+void
+frame_quota_exit (struct thread *t) {
+  struct quota_record *r;
+
+  lock_acquire (&frame_lock);
+  quota_update (t);
+  r = &quota_history[quota_exit_cnt++ % QUOTA_HISTORY];
+  r->tid = t->tid;
+  strlcpy (r->name, t->name, sizeof r->name);
+  r->rss_peak = t->rss_peak;
+  r->rss_target = t->rss_target;
+  r->fault_rate = t->fault_rate;
+  lock_release (&frame_lock);
+}
+
+/* Counts a page fault by T towards its fault rate. */
+void
+frame_note_fault (struct thread *t) {
+  lock_acquire (&frame_lock);
+  t->fault_cnt++;
+  quota_update (t);
+  lock_release (&frame_lock);
+}
+
+/* Prints the resident set, target, and fault rate of every live
+   process and of the last few to exit. */
+void
+frame_print_quotas (void) {
+  enum intr_level old_level;
+  unsigned i;
+
+  printf ("VM quotas: %zu frames, fault rate in faults per %d ticks\n",
+          frame_cnt, PFF_WINDOW);
+  old_level = intr_disable ();
+  thread_foreach (quota_print, NULL);
+  intr_set_level (old_level);
+
+  for (i = quota_exit_cnt > QUOTA_HISTORY ? quota_exit_cnt - QUOTA_HISTORY : 0;
+       i < quota_exit_cnt; i++) {
+    struct quota_record *r = &quota_history[i % QUOTA_HISTORY];
+
+    printf ("  exited tid %4d %-16s peak rss %5d target %5d rate %4d\n",
+            r->tid, r->name, r->rss_peak, r->rss_target, r->fault_rate);
+  }
+}
+
+/* Pins the frame PAGE is resident in and returns it, or returns a
+   null pointer if PAGE is not resident. */
+uint8_t *
+frame_pin_page (struct s_page *page) {
+  uint8_t *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = page->kpage;
+  if (kpage != NULL)
+    frame_slot (kpage)->pin_cnt++;
+  lock_release (&frame_lock);
+
+  return kpage;
 }
 
 void
@@ -47,7 +357,9 @@ frame_pin (uint8_t *kpage) {
   struct frame *f = frame_find (kpage);
 
   if (f != NULL) {
-    f->pinned = true;
+    lock_acquire (&frame_lock);
+    f->pin_cnt++;
+    lock_release (&frame_lock);
   }
 }
 
@@ -57,26 +369,320 @@ frame_unpin (uint8_t *kpage) {
   struct frame *f = frame_find (kpage);
 
   if (f != NULL) {
-    f->pinned = false;
+    lock_acquire (&frame_lock);
+    ASSERT (f->pin_cnt > 0);
+    f->pin_cnt--;
+    frame_release (f);
+    lock_release (&frame_lock);
   }
 }
 
+/* Returns the descriptor of allocated frame KPAGE, or a null
+   pointer if KPAGE is not an allocated user frame. */
 struct frame *
 frame_find (uint8_t *kpage) {
-  struct list_elem *curr;
-  struct frame *frame;
-
-  for (curr=list_begin(&frame_table); curr!=list_tail(&frame_table);
-          curr=list_next(curr)) {
-    frame = list_entry(curr, struct frame, elem);
-    if (frame->kpage == kpage) {
-      return frame;
-    }
-  }
-  return NULL;
+  struct frame *f = frame_slot (kpage);
+
+  if (f == NULL || f->kpage != kpage)
+    return NULL;
+  return f;
 }
 
 bool
 is_frame_allocated (uint8_t *kpage) {
   return frame_find (kpage) != NULL;
 }
+
+/* Returns the frame table slot for KPAGE, or a null pointer if
+   KPAGE does not lie in the user pool. */
+static struct frame *
+frame_slot (uint8_t *kpage) {
+  size_t idx;
+
+  if (kpage < frame_base || pg_ofs (kpage) != 0)
+    return NULL;
+  idx = (kpage - frame_base) / PGSIZE;
+  return idx < frame_cnt ? &frame_table[idx] : NULL;
+}
+
+/* Allocates a pinned frame for PAGE, evicting if EVICT is true
+   and the user pool is empty. */
+static uint8_t *
+frame_get (struct s_page *page, bool evict) {
+  struct frame *f;
+  uint8_t *kpage = palloc_get_page (PAL_USER);
+
+  lock_acquire (&frame_lock);
+  if (kpage == NULL && evict)
+    kpage = frame_evict ();
+
+  if (kpage != NULL) {
+    f = frame_slot (kpage);
+
+    f->kpage = kpage;
+    f->pin_cnt = 1;
+    frame_map (f, page);
+  }
+  lock_release (&frame_lock);
+
+  return kpage;
+}
+
+/* Records PAGE as mapped to F.  Called with frame_lock held. */
+static void
+frame_map (struct frame *f, struct s_page *page) {
+  struct thread *owner = page->owner;
+
+  list_push_back (&f->pages, &page->frame_elem);
+  f->ref_cnt++;
+  page->kpage = f->kpage;
+  if (++owner->rss > owner->rss_peak)
+    owner->rss_peak = owner->rss;
+}
+
+/* Undoes frame_map (F, PAGE).  Called with frame_lock held. */
+static void
+frame_unlink (struct frame *f, struct s_page *page) {
+  list_remove (&page->frame_elem);
+  f->ref_cnt--;
+  page->kpage = NULL;
+  page->owner->rss--;
+}
+
+/* Frees F once no page maps it and nobody has it pinned.  Called
+   with frame_lock held. */
+static void
+frame_release (struct frame *f) {
+  if (f->ref_cnt == 0 && f->pin_cnt == 0) {
+    palloc_free_page (f->kpage);
+    frame_clear (f);
+  }
+}
+
+/* Marks F free and drops it from the share table.  Called with
+   frame_lock held, once no page is mapped to F. */
+static void
+frame_clear (struct frame *f) {
+  ASSERT (list_empty (&f->pages));
+
+  if (f->inode != NULL)
+    hash_delete (&share_table, &f->share_elem);
+  f->kpage = NULL;
+  f->ref_cnt = 0;
+  f->pin_cnt = 0;
+  f->inode = NULL;
+}
+
+/* Returns true if any page mapped to F has been accessed since
+   the clock last passed, clearing the accessed bits.  Each such
+   page counts towards its owner's working set. */
+static bool
+frame_accessed (struct frame *f) {
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e)) {
+    struct s_page *page = list_entry (e, struct s_page, frame_elem);
+    uint32_t *pd = page->owner->pagedir;
+
+    if (pagedir_is_accessed (pd, page->uaddr)) {
+      pagedir_set_accessed (pd, page->uaddr, false);
+      page->owner->ws_sampled++;
+      accessed = true;
+    }
+  }
+  return accessed;
+}
+
+/* Maps every page of F back in, after a failed page-out. */
+static void
+frame_remap (struct frame *f) {
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e)) {
+    struct s_page *page = list_entry (e, struct s_page, frame_elem);
+    uint32_t *pd = page->owner->pagedir;
+
+    pagedir_set_page (pd, page->uaddr, f->kpage, page->writable);
+    pagedir_set_dirty (pd, page->uaddr, true);
+  }
+}
+
+/* Unmaps every page of F and saves the contents if needed.  Dirty
+   memory-mapped pages are written back to their file, and other
+   pages that are dirty, or that live only in swap, are written to
+   swap; clean file and zero pages are simply dropped and reloaded
+   from their source on the next fault.  Returns false, leaving F
+   mapped, if swap is full or the file system is busy. */
+static bool
+frame_page_out (struct frame *f) {
+  struct s_page *first = list_entry (list_front (&f->pages),
+                                     struct s_page, frame_elem);
+  struct list_elem *e;
+  bool dirty = false;
+  size_t slot = SWAP_ERROR;
+
+  /* Unmap first, so that no owner can change the page after we
+     have decided whether it is dirty. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e)) {
+    struct s_page *page = list_entry (e, struct s_page, frame_elem);
+    uint32_t *pd = page->owner->pagedir;
+
+    pagedir_clear_page (pd, page->uaddr);
+    if (pagedir_is_dirty (pd, page->uaddr) || page->location == SWAP)
+      dirty = true;
+  }
+
+  if (dirty && first->mmap != NULL) {
+    /* A thread holding filesys_lock may be waiting for frame_lock
+       in a page fault, so never block on it here. */
+    bool held = lock_held_by_current_thread (&filesys_lock);
+
+    if (!held && !lock_try_acquire (&filesys_lock)) {
+      frame_remap (f);
+      return false;
+    }
+    s_page_write_back (first, f->kpage);
+    if (!held)
+      lock_release (&filesys_lock);
+  } else if (dirty) {
+    slot = swap_out (f->kpage);
+    if (slot == SWAP_ERROR) {
+      frame_remap (f);
+      return false;
+    }
+  }
+
+  while (!list_empty (&f->pages)) {
+    struct s_page *page = list_entry (list_front (&f->pages),
+                                      struct s_page, frame_elem);
+    frame_unlink (f, page);
+    if (slot != SWAP_ERROR) {
+      /* Pages sharing the frame since fork share the slot too;
+         swap_out counted the first of them. */
+      if (page != first)
+        swap_dup (slot);
+      page->location = SWAP;
+      page->swap_slot = slot;
+    }
+  }
+  return true;
+}
+
+/* Picks a victim with the clock algorithm, giving every recently
+   accessed frame a second chance, and pages it out.  A first
+   sweep only considers frames of processes over their
+   resident-set target; if none of those can go, a second sweep
+   considers every frame.  Returns the freed frame, or a null
+   pointer if no frame could be paged out.
+
+   Runs with frame_lock held for the whole page-out, so that a
+   fault on a victim page waits in frame_alloc until its s_page
+   records where the contents went. */
+static uint8_t *
+frame_evict (void) {
+  int pass;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (pass = 0; pass < 2; pass++)
+    for (i = 0; i < 2 * frame_cnt; i++) {
+      struct frame *f = &frame_table[clock_hand];
+      uint8_t *kpage = f->kpage;
+
+      clock_hand = (clock_hand + 1) % frame_cnt;
+      if (kpage == NULL || f->pin_cnt > 0)
+        continue;
+      if (pass == 0 && !quota_exceeded (f))
+        continue;
+      if (frame_accessed (f) || !frame_page_out (f))
+        continue;
+      frame_clear (f);
+      return kpage;
+    }
+
+  return NULL;
+}
+
+/* Closes T's fault-rate windows that have ended and adjusts its
+   resident-set target.  Called with frame_lock held. */
+static void
+quota_update (struct thread *t) {
+  int64_t now = timer_ticks ();
+  int64_t windows = (now - t->pff_tick) / PFF_WINDOW;
+  int floor;
+
+  if (windows <= 0)
+    return;
+
+  t->fault_rate = t->fault_cnt / windows;
+  t->ws_size = t->ws_sampled < t->rss ? t->ws_sampled : t->rss;
+  floor = t->ws_size > RSS_TARGET_MIN ? t->ws_size : RSS_TARGET_MIN;
+
+  if (t->fault_rate > PFF_HIGH) {
+    t->rss_target += t->rss_target / 4 + 1;
+    if ((size_t) t->rss_target > frame_cnt)
+      t->rss_target = frame_cnt;
+  } else if (t->fault_rate < PFF_LOW) {
+    /* Shrink once for every quiet window. */
+    for (; windows > 0 && t->rss_target > floor; windows--)
+      t->rss_target -= t->rss_target / 8 + 1;
+    if (t->rss_target < floor)
+      t->rss_target = floor;
+  }
+
+  t->fault_cnt = 0;
+  t->ws_sampled = 0;
+  t->pff_tick = now;
+}
+
+/* Returns true if some page mapped to F belongs to a process over
+   its resident-set target.  Called with frame_lock held. */
+static bool
+quota_exceeded (struct frame *f) {
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e)) {
+    struct thread *owner = list_entry (e, struct s_page, frame_elem)->owner;
+
+    quota_update (owner);
+    if (owner->rss > owner->rss_target)
+      return true;
+  }
+  return false;
+}
+
+/* Prints the quota of T, if it is a user process. */
+static void
+quota_print (struct thread *t, void *aux UNUSED) {
+  if (t->pagedir == NULL)
+    return;
+  printf ("  live   tid %4d %-16s rss %5d target %5d rate %4d ws %5d\n",
+          t->tid, t->name, t->rss, t->rss_target, t->fault_rate, t->ws_size);
+}
+
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED) {
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+
+  return hash_bytes (&f->inode, sizeof f->inode)
+         ^ hash_int (f->ofs) ^ hash_int (f->read_bytes);
+}
+
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+    void *aux UNUSED) {
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
@@ -1,21 +1,51 @@
-#include "list.h"
-#include "threads/synch.h"
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
 
-static struct list frame_table;
-static struct lock frame_lock;
+struct inode;
+struct s_page;
+struct thread;
 
+/* A user frame.  The frame table holds one of these for every
+   page in the user pool, indexed by its position in the pool, so
+   looking up the descriptor for a kernel page takes constant
+   time.  A frame whose KPAGE is null is not allocated.
+
+   Usually a single s_page is mapped to a frame, but read-only
+   executable text is shared: every process running the same
+   binary maps the same frame, found through the share table by
+   its inode and file offset. */
 struct frame {
-  struct list_elem elem;
-  uint8_t *upage;
   uint8_t *kpage;
-  struct thread *owner;
-  bool pinned;
+  struct list pages;            /* s_pages mapped to this frame. */
+  int ref_cnt;                  /* Number of entries in PAGES. */
+  unsigned pin_cnt;             /* Never evicted while nonzero. */
+
+  /* Position of a shared text page.  INODE is null for frames
+     that are not in the share table. */
+  struct inode *inode;
+  off_t ofs;
+  uint32_t read_bytes;
+  struct hash_elem share_elem;
 };
 
 void frame_init (void);
 
-uint8_t *frame_alloc (uint8_t *);
-void frame_free (uint8_t *);
+uint8_t *frame_alloc (struct s_page *);
+uint8_t *frame_try_alloc (struct s_page *);
+uint8_t *frame_share_get (struct s_page *, struct inode *, off_t, uint32_t);
+uint8_t *frame_zero_get (struct s_page *);
+void frame_share_put (uint8_t *, struct inode *, off_t, uint32_t);
+void frame_unmap (struct s_page *);
+uint8_t *frame_pin_page (struct s_page *);
+bool frame_fork (struct s_page *, struct s_page *);
+bool frame_unshare (struct s_page *);
+void frame_quota_init (struct thread *);
+void frame_quota_exit (struct thread *);
+void frame_note_fault (struct thread *);
+void frame_print_quotas (void);
 void frame_pin (uint8_t *);
 void frame_unpin (uint8_t *);
 struct frame *frame_find (uint8_t *);
@@ -0,0 +1,132 @@
+#include "vm/lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* A small LZ77 codec, in the spirit of LZRW1, for compressing
+   pages on their way to swap.  It favors speed over ratio: one
+   hash probe per position, no lazy matching.
+
+   The output is a series of groups, each a flag byte followed by
+   up to 8 items.  Bit I of the flag byte, counting from the least
+   significant, tells whether item I is a literal byte (0) or a
+   match (1).  A match is two bytes: the high 4 bits of the first
+   hold the length minus LZ_MIN_MATCH, and the remaining 12 bits
+   the distance back to the copy's source, 1 to LZ_MAX_OFS. */
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15)
+#define LZ_MAX_OFS 4095
+#define LZ_HASH_BITS 10
+
+/* Hashes the 3 bytes at P. */
+static inline unsigned
+lz_hash (const uint8_t *p)
+{
+  unsigned v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the LEN bytes at SRC_ into DST_, which has room for
+   DST_MAX bytes, using the LZ_WORK_SIZE bytes at WORK as scratch.
+   Returns the compressed size, or 0 if it would exceed DST_MAX.
+   LEN must be less than 65536. */
+size_t
+lz_compress (const void *src_, size_t len, void *dst_, size_t dst_max,
+             void *work)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint16_t *table = work;       /* Position + 1 of last hash hit. */
+  size_t ip = 0;
+  size_t op = 0;
+
+  ASSERT (len < 65536);
+  memset (table, 0, LZ_WORK_SIZE);
+
+  while (ip < len)
+    {
+      size_t flag_pos;
+      uint8_t flags = 0;
+      int bit;
+
+      /* Room for a flag byte and 8 two-byte items. */
+      if (op + 17 > dst_max)
+        return 0;
+      flag_pos = op++;
+
+      for (bit = 0; bit < 8 && ip < len; bit++)
+        {
+          size_t match_len = 0;
+          size_t ofs = 0;
+
+          if (ip + LZ_MIN_MATCH <= len)
+            {
+              unsigned h = lz_hash (src + ip);
+              size_t cand = table[h];
+
+              table[h] = ip + 1;
+              if (cand != 0 && ip - (cand - 1) <= LZ_MAX_OFS)
+                {
+                  cand--;
+                  ofs = ip - cand;
+                  while (match_len < LZ_MAX_MATCH && ip + match_len < len
+                         && src[cand + match_len] == src[ip + match_len])
+                    match_len++;
+                }
+            }
+
+          if (match_len >= LZ_MIN_MATCH)
+            {
+              flags |= 1 << bit;
+              dst[op++] = ((match_len - LZ_MIN_MATCH) << 4) | (ofs >> 8);
+              dst[op++] = ofs & 0xff;
+              ip += match_len;
+            }
+          else
+            dst[op++] = src[ip++];
+        }
+      dst[flag_pos] = flags;
+    }
+  return op;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC_, which must expand to
+   exactly DST_LEN bytes, into DST_.  Returns false if the input
+   is malformed. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip < src_len)
+    {
+      uint8_t flags = src[ip++];
+      int bit;
+
+      for (bit = 0; bit < 8 && ip < src_len; bit++)
+        if (flags & (1 << bit))
+          {
+            size_t match_len, ofs;
+
+            if (ip + 2 > src_len)
+              return false;
+            match_len = (src[ip] >> 4) + LZ_MIN_MATCH;
+            ofs = ((src[ip] & 0x0f) << 8) | src[ip + 1];
+            ip += 2;
+            if (ofs == 0 || ofs > op || op + match_len > dst_len)
+              return false;
+            for (; match_len > 0; match_len--, op++)
+              dst[op] = dst[op - ofs];
+          }
+        else
+          {
+            if (op >= dst_len)
+              return false;
+            dst[op++] = src[ip++];
+          }
+    }
+  return op == dst_len;
+}
@@ -0,0 +1,9 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes of scratch memory lz_compress needs. */
+#define LZ_WORK_SIZE (1024 * sizeof (uint16_t))
+
+size_t lz_compress (const void *, size_t, void *, size_t, void *work);
+bool lz_decompress (const void *, size_t, void *, size_t);
@@ -4,18 +4,79 @@
 #include "userprog/pagedir.h"
 #include "vm/page.h"
 #include "vm/frame.h"
+#include "vm/swap.h"
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Default and largest fault-around windows, in pages. */
+#define FAULT_AROUND_DEFAULT 4
+#define FAULT_AROUND_MAX 32
+
+/* Number of pages brought in by one fault in a file-backed
+   region, counting the faulting page; 1 turns fault-around off. */
+size_t fault_around_pages = FAULT_AROUND_DEFAULT;
+
+/* Print each process's fault-around savings when it exits? */
+bool fault_around_report;
 
 static unsigned hash_func (const struct hash_elem *, void *);
 static bool less_func (const struct hash_elem *, const struct hash_elem *, void *);
+static void s_page_free (struct hash_elem *, void *);
+static bool s_page_insert (struct s_page *);
 static bool install_s_page (uint8_t *, uint8_t *, bool);
-static bool s_page_load_file (struct s_page *);
-static bool s_page_load_zero (struct s_page *);
-
+static bool s_page_load_file (struct s_page *, uint8_t *);
+static bool s_page_load_zero (struct s_page *, uint8_t *);
+static bool s_page_load_swap (struct s_page *, uint8_t *);
+static bool s_page_is_shared (struct s_page *);
+static void s_page_unload (struct s_page *);
+static void s_page_fault_around (struct s_page *);
+static void mmap_unmap (struct mmap *);
+
+/* Initializes the current process's supplemental page table. */
 void
 s_page_init () {
-  hash_init (&s_page_table, &hash_func, &less_func, NULL);
-  lock_init (&s_page_lock);
+  struct thread *t = thread_current ();
+
+  hash_init (&t->s_page_table, &hash_func, &less_func, NULL);
+  lock_init (&t->s_page_lock);
+  list_init (&t->mmap_list);
+  t->next_mapid = 0;
+  t->faults_saved = 0;
+  frame_quota_init (t);
+}
+
+/* Frees the current process's supplemental page table, unmapping
+   its resident pages and releasing the swap slots it holds.  Must
+   run while the process's page directory still exists. */
+void
+s_page_destroy () {
+  struct thread *t = thread_current ();
+
+  frame_quota_exit (t);
+  while (!list_empty (&t->mmap_list)) {
+    struct mmap *m = list_entry (list_front (&t->mmap_list),
+                                 struct mmap, elem);
+    s_page_munmap (m->mapid);
+  }
+
+  lock_acquire (&t->s_page_lock);
+  hash_destroy (&t->s_page_table, &s_page_free);
+  lock_release (&t->s_page_lock);
+}
+
+/* Adds PAGE to the current process's supplemental page table.
+   Returns false if a page is already recorded at its address. */
+static bool
+s_page_insert (struct s_page *page) {
+  struct thread *t = thread_current ();
+  bool success;
+
+  lock_acquire (&t->s_page_lock);
+  success = hash_insert (&t->s_page_table, &page->h_elem) == NULL;
+  lock_release (&t->s_page_lock);
+
+  return success;
 }
 
 bool
@@ -30,16 +91,20 @@ s_page_insert_file (uint8_t *uaddr, struct file *file, off_t ofs,
   // printf ("s_page_insert_file at %p\n", uaddr);
   page->uaddr = uaddr;
   page->location = DISK;
+  page->owner = thread_current ();
+  page->kpage = NULL;
+  page->mmap = NULL;
   page->writable = writable;
+  page->swap_slot = SWAP_ERROR;
 
   page->file_info.file = file;
   page->file_info.ofs = ofs;
   page->file_info.read_bytes = read_bytes;
   page->file_info.zero_bytes = zero_bytes;
 
-  lock_acquire(&s_page_lock);
-  success = hash_insert (&s_page_table, &page->h_elem) == NULL;
-  lock_release(&s_page_lock);
+  success = s_page_insert (page);
+  if (!success)
+    free (page);
 
   return success;
 }
@@ -56,101 +121,508 @@ s_page_insert_zero (uint8_t *uaddr) {
   // printf ("s_page_insert_zero at %p\n", uaddr);
   page->uaddr = uaddr;
   page->location = ZERO;
+  page->owner = thread_current ();
+  page->kpage = NULL;
+  page->mmap = NULL;
+  page->file_info.file = NULL;
   page->writable = true;
+  page->swap_slot = SWAP_ERROR;
 
-  lock_acquire(&s_page_lock);
-  success = hash_insert (&s_page_table, &page->h_elem) == NULL;
-  lock_release(&s_page_lock);
+  success = s_page_insert (page);
+  if (!success)
+    free (page);
 
   return success;
 }
 
+/* Brings PAGE into a frame and maps it, for a write access if
+   WRITE is true.  A read of a ZERO page maps the shared zero
+   frame read-only, leaving the private frame to the first write.
+   Read-only executable text is looked up in the shared frames
+   first, so processes running the same binary share one copy.
+   Otherwise a new frame is obtained before looking at PAGE's
+   location, so that if PAGE is being evicted right now, the
+   eviction has finished updating it by the time frame_alloc
+   returns. */
 bool
-s_page_load (struct s_page *page) {
-  bool success = true;
+s_page_load (struct s_page *page, bool write) {
+  bool from_file = page->location == DISK;
+  bool shared = s_page_is_shared (page);
+  bool writable = page->writable;
+  struct inode *inode = NULL;
+  uint8_t *kpage = NULL;
+  bool success = false;
+
+  if (page->kpage != NULL)
+    return true;
+  frame_note_fault (page->owner);
+
+  if (!write && page->location == ZERO) {
+    kpage = frame_zero_get (page);
+    success = kpage != NULL;
+    writable = false;
+  }
+
+  if (kpage == NULL && shared) {
+    inode = file_get_inode (page->file_info.file);
+    kpage = frame_share_get (page, inode, page->file_info.ofs,
+                             page->file_info.read_bytes);
+    success = kpage != NULL;
+  }
+
+  if (kpage == NULL) {
+    kpage = frame_alloc (page);
+    if (kpage == NULL)
+      return false;
+    writable = page->writable;
+
+    switch (page->location) {
+      case DISK:
+        success = s_page_load_file (page, kpage);
+        break;
+      case ZERO:
+        success = s_page_load_zero (page, kpage);
+        break;
+      case SWAP:
+        success = s_page_load_swap (page, kpage);
+        break;
+    }
+    if (success && shared)
+      frame_share_put (kpage, inode, page->file_info.ofs,
+                       page->file_info.read_bytes);
+  }
+
+  /* Add the page to the process's address space. */
+  if (success && !install_s_page (page->uaddr, kpage, writable))
+    success = false;
+
+  frame_unpin (kpage);
+  if (!success)
+    frame_unmap (page);
+  else if (from_file)
+    s_page_fault_around (page);
+
+  return success;
+}
+
+/* Maps the pages that follow PAGE in the same file, up to the
+   fault-around window, so that sequential access does not fault
+   on every page.  Shared text already resident is mapped as is;
+   the rest is read in one pass under filesys_lock.  Stops at the
+   first page that is not the file's next page, or as soon as no
+   free frame is left, since evicting to read ahead would only
+   trade one fault for another. */
+static void
+s_page_fault_around (struct s_page *page) {
+  struct s_page *batch[FAULT_AROUND_MAX];
+  uint8_t *kpages[FAULT_AROUND_MAX];
+  bool loaded[FAULT_AROUND_MAX];
+  struct file *file = page->file_info.file;
+  size_t window = fault_around_pages;
+  size_t cnt = 0;
+  size_t i;
+  bool held;
+
+  if (window > FAULT_AROUND_MAX)
+    window = FAULT_AROUND_MAX;
 
-  switch (page->location) {
-    case DISK:
-      success = s_page_load_file (page);
+  for (i = 1; i < window; i++) {
+    uint8_t *upage = page->uaddr + i * PGSIZE;
+    off_t ofs = page->file_info.ofs + (off_t) (i * PGSIZE);
+    struct s_page *next;
+    uint8_t *kpage;
+
+    if (!is_user_vaddr (upage))
       break;
-    case ZERO:
-      success = s_page_load_zero (page);
+    next = page_lookup (upage);
+    if (next == NULL || next->location != DISK
+        || next->file_info.file != file || next->file_info.ofs != ofs)
       break;
+    if (next->kpage != NULL)
+      continue;
+
+    if (s_page_is_shared (next)) {
+      kpage = frame_share_get (next, file_get_inode (file), ofs,
+                               next->file_info.read_bytes);
+      if (kpage != NULL) {
+        bool installed = install_s_page (upage, kpage, next->writable);
+
+        frame_unpin (kpage);
+        if (installed)
+          thread_current ()->faults_saved++;
+        else
+          frame_unmap (next);
+        continue;
+      }
+    }
+
+    kpage = frame_try_alloc (next);
+    if (kpage == NULL)
+      break;
+    batch[cnt] = next;
+    kpages[cnt++] = kpage;
   }
 
+  if (cnt == 0)
+    return;
+
+  held = lock_held_by_current_thread (&filesys_lock);
+  if (!held)
+    lock_acquire(&filesys_lock);
+  for (i = 0; i < cnt; i++)
+    loaded[i] = s_page_load_file (batch[i], kpages[i]);
+  if (!held)
+    lock_release(&filesys_lock);
+
+  for (i = 0; i < cnt; i++) {
+    struct s_page *next = batch[i];
+    bool success = loaded[i];
+
+    if (success && s_page_is_shared (next))
+      frame_share_put (kpages[i], file_get_inode (file),
+                       next->file_info.ofs, next->file_info.read_bytes);
+    if (success && !install_s_page (next->uaddr, kpages[i], next->writable))
+      success = false;
+
+    frame_unpin (kpages[i]);
+    if (success)
+      thread_current ()->faults_saved++;
+    else
+      frame_unmap (next);
+  }
+}
+
+/* Copies PARENT's address space into the current process, a
+   child PARENT is forking, without copying any page: resident
+   pages become copy-on-write and the rest keep their source.
+   Memory-mapped files are not inherited.  PARENT must be blocked
+   until this returns.  Returns false if memory runs out. */
+bool
+s_page_fork (struct thread *parent) {
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  lock_acquire (&parent->s_page_lock);
+  hash_first (&i, &parent->s_page_table);
+  while (success && hash_next (&i)) {
+    struct s_page *p = hash_entry (hash_cur (&i), struct s_page, h_elem);
+    struct s_page *page;
+
+    if (p->mmap != NULL)
+      continue;
+
+    page = malloc (sizeof (struct s_page));
+    if (!page) {
+      success = false;
+      break;
+    }
+    *page = *p;
+    page->owner = t;
+    page->kpage = NULL;
+    /* Executable pages now come from our own handle. */
+    if (page->file_info.file != NULL)
+      page->file_info.file = t->self_file;
+
+    success = s_page_insert (page);
+    if (success)
+      success = frame_fork (p, page);
+    else
+      free (page);
+  }
+  lock_release (&parent->s_page_lock);
+
   return success;
 }
 
+/* Handles a write fault on present PAGE, which must be writable:
+   it is shared copy-on-write since fork, or maps the zero
+   frame. */
+bool
+s_page_unshare (struct s_page *page) {
+  ASSERT (page->writable);
+
+  frame_note_fault (page->owner);
+  return frame_unshare (page);
+}
+
+/* Loads PAGE if needed and pins its frame, so that the kernel can
+   touch it without faulting.  If WRITE, PAGE must be writable and
+   also gets a private, writable frame.  Returns false if PAGE
+   cannot be loaded or may not be written. */
 static bool
-s_page_load_file (struct s_page *page) {
-  uint8_t *upage = page->uaddr;
+s_page_pin (struct s_page *page, bool write) {
+  uint32_t *pd = page->owner->pagedir;
+
+  if (write && !page->writable)
+    return false;
+
+  for (;;) {
+    uint8_t *kpage = frame_pin_page (page);
+
+    if (kpage == NULL) {
+      /* Loading leaves the page unpinned, so it may be evicted
+         again before we pin it; just go around. */
+      if (!s_page_load (page, write))
+        return false;
+    } else if (!write || pagedir_is_writable (pd, page->uaddr))
+      return true;
+    else {
+      frame_unpin (kpage);
+      if (!s_page_unshare (page))
+        return false;
+    }
+  }
+}
+
+/* Faults in and pins every page of the SIZE bytes of user memory
+   at UADDR, growing the stack for pages just below ESP, so that
+   file I/O on the buffer never page-faults while it holds
+   filesys_lock.  If WRITE, the pages must be writable.  Returns
+   false, with nothing left pinned, if part of the buffer is not
+   valid user memory or no frame can be found for it.  The caller
+   must unpin the buffer with s_page_unpin_range, so it should not
+   pin more than a small fraction of the user pool at once. */
+bool
+s_page_pin_range (const void *uaddr, size_t size, bool write, void *esp) {
+  const uint8_t *start = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  const uint8_t *p;
+
+  if (size == 0)
+    return true;
+  if (end < (const uint8_t *) uaddr || !is_user_vaddr (end - 1))
+    return false;
+
+  for (p = start; p < end; p += PGSIZE) {
+    const uint8_t *addr = p < (const uint8_t *) uaddr ? uaddr : p;
+    struct s_page *page = page_lookup (p);
+
+    if (page == NULL && is_stack_access ((void *) addr, esp)
+        && s_page_insert_zero ((uint8_t *) p))
+      page = page_lookup (p);
+    if (page == NULL || !s_page_pin (page, write)) {
+      s_page_unpin_range (start, p - start);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Unpins the SIZE bytes of user memory at UADDR, pinned by
+   s_page_pin_range. */
+void
+s_page_unpin_range (const void *uaddr, size_t size) {
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  const uint8_t *p;
+
+  for (p = pg_round_down (uaddr); p < end; p += PGSIZE) {
+    struct s_page *page = page_lookup (p);
+
+    ASSERT (page != NULL && page->kpage != NULL);
+    frame_unpin (page->kpage);
+  }
+}
+
+/* Returns true if PAGE may share a frame with the same page of
+   other processes: it is read-only and comes straight from its
+   file. */
+static bool
+s_page_is_shared (struct s_page *page) {
+  return page->location == DISK && !page->writable;
+}
+
+static bool
+s_page_load_file (struct s_page *page, uint8_t *kpage) {
   struct file *file = page->file_info.file;
   off_t ofs = page->file_info.ofs;
   uint32_t read_bytes = page->file_info.read_bytes;
   uint32_t zero_bytes = page->file_info.zero_bytes;
-  bool writable = page->writable;
+  bool held = lock_held_by_current_thread (&filesys_lock);
+  bool success;
+
+  /* Load this page.  We may be faulting on a user buffer inside a
+     read or write system call, which already holds the lock. */
+  if (!held)
+    lock_acquire(&filesys_lock);
+  success = file_read_at (file, kpage, read_bytes, ofs) == (int) read_bytes;
+  if (!held)
+    lock_release(&filesys_lock);
+  if (!success)
+    return false;
+  memset (kpage + read_bytes, 0, zero_bytes);
+
+  return true;
+}
+
+/* Writes the data of memory-mapped PAGE, held in frame KPAGE,
+   back to its file.  The caller must hold filesys_lock. */
+void
+s_page_write_back (struct s_page *page, const void *kpage) {
+  ASSERT (page->mmap != NULL);
+  ASSERT (lock_held_by_current_thread (&filesys_lock));
+
+  file_write_at (page->file_info.file, kpage, page->file_info.read_bytes,
+                 page->file_info.ofs);
+}
+
+/* Maps FILE into the current process's memory starting at ADDR.
+   Pages are only read from the file on first touch.  Returns the
+   new mapping's id, or -1 if ADDR is null or misaligned, FILE is
+   empty, or the range overlaps pages already in use. */
+int
+s_page_mmap (struct file *file, uint8_t *addr) {
+  struct thread *t = thread_current ();
+  struct mmap *m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return -1;
 
-  // printf ("s_page_load_file at %p\n", upage);
   lock_acquire(&filesys_lock);
-  file_seek (file, ofs);
+  length = file_length (file);
   lock_release(&filesys_lock);
+  if (length == 0)
+    return -1;
 
-  /* Get a page of memory. */
-  uint8_t *kpage = frame_alloc (upage);
-  if (kpage == NULL)
-    return false;
+  m = malloc (sizeof (struct mmap));
+  if (!m) {
+    return -1;
+  }
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
 
-  lock_acquire(&filesys_lock);
-  /* Load this page. */
-  if (file_read (file, kpage, read_bytes) != (int) read_bytes)
-    {
-      frame_free (kpage);
-      lock_release(&filesys_lock);
-      return false;
+  for (i = 0; i < m->page_cnt; i++) {
+    uint8_t *upage = addr + i * PGSIZE;
+
+    if (!is_user_vaddr (upage) || page_lookup (upage) != NULL) {
+      free (m);
+      return -1;
     }
-  lock_release(&filesys_lock);
-  memset (kpage + read_bytes, 0, zero_bytes);
+  }
 
-  /* Add the page to the process's address space. */
-  if (!install_s_page (upage, kpage, writable))
-    {
-      frame_free (kpage);
-      return false;
+  /* Keep our own handle, so that the mapping outlives the fd. */
+  lock_acquire(&filesys_lock);
+  m->file = file_reopen (file);
+  lock_release(&filesys_lock);
+  if (m->file == NULL) {
+    free (m);
+    return -1;
+  }
+  m->mapid = t->next_mapid++;
+  list_push_back (&t->mmap_list, &m->elem);
+
+  for (i = 0; i < m->page_cnt; i++) {
+    off_t ofs = i * PGSIZE;
+    uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+    if (!s_page_insert_file (addr + ofs, m->file, ofs, read_bytes,
+                             PGSIZE - read_bytes, true)) {
+      m->page_cnt = i;
+      s_page_munmap (m->mapid);
+      return -1;
     }
+    page_lookup (addr + ofs)->mmap = m;
+  }
 
-  return true;
+  return m->mapid;
 }
 
-static bool
-s_page_load_zero (struct s_page *page) {
-  uint8_t *upage = page->uaddr;
+/* Unmaps the current process's mapping MAPID, writing its dirty
+   pages back to the file.  Returns false if there is no such
+   mapping. */
+bool
+s_page_munmap (int mapid) {
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mmap_list); e != list_end (&t->mmap_list);
+       e = list_next (e)) {
+    struct mmap *m = list_entry (e, struct mmap, elem);
+
+    if (m->mapid == mapid) {
+      list_remove (&m->elem);
+      mmap_unmap (m);
+      lock_acquire(&filesys_lock);
+      file_close (m->file);
+      lock_release(&filesys_lock);
+      free (m);
+      return true;
+    }
+  }
+  return false;
+}
 
-  // printf ("s_page_load_zero at %p\n", upage);
+/* Removes every page of M from the current process. */
+static void
+mmap_unmap (struct mmap *m) {
+  struct thread *t = thread_current ();
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++) {
+    struct s_page *page = page_lookup (m->addr + i * PGSIZE);
+
+    if (page == NULL)
+      continue;
+    s_page_unload (page);
+    lock_acquire (&t->s_page_lock);
+    hash_delete (&t->s_page_table, &page->h_elem);
+    lock_release (&t->s_page_lock);
+    free (page);
+  }
+}
 
-  /* Get a page of memory. */
-  uint8_t *kpage = frame_alloc (upage);
-  if (kpage == NULL)
-    return false;
+/* Takes PAGE out of memory, first writing it back to its file if
+   it is memory-mapped and was written since it was loaded. */
+static void
+s_page_unload (struct s_page *page) {
+  uint8_t *kpage = frame_pin_page (page);
+
+  if (kpage != NULL) {
+    if (page->mmap != NULL
+        && pagedir_is_dirty (page->owner->pagedir, page->uaddr)) {
+      bool held = lock_held_by_current_thread (&filesys_lock);
+
+      if (!held)
+        lock_acquire(&filesys_lock);
+      s_page_write_back (page, kpage);
+      if (!held)
+        lock_release(&filesys_lock);
+    }
+    frame_unpin (kpage);
+  }
+  frame_unmap (page);
+}
 
+static bool
+s_page_load_zero (struct s_page *page UNUSED, uint8_t *kpage) {
   memset (kpage, 0, PGSIZE);
+  return true;
+}
 
-  /* Add the page to the process's address space. */
-  if (!install_s_page (upage, kpage, true))
-    {
-      frame_free (kpage);
-      return false;
-    }
+/* Reads PAGE back from its swap slot.  PAGE stays a SWAP page,
+   since its contents now exist nowhere but in memory. */
+static bool
+s_page_load_swap (struct s_page *page, uint8_t *kpage) {
+  if (page->swap_slot == SWAP_ERROR)
+    return false;
 
+  swap_in (page->swap_slot, kpage);
+  page->swap_slot = SWAP_ERROR;
   return true;
 }
 
 struct s_page *
 page_lookup (const void *uaddr) {
+  struct thread *t = thread_current ();
   struct s_page page;
   struct hash_elem *h_elem;
 
   page.uaddr = pg_round_down (uaddr);
-  h_elem = hash_find (&s_page_table, &page.h_elem);
+  lock_acquire (&t->s_page_lock);
+  h_elem = hash_find (&t->s_page_table, &page.h_elem);
+  lock_release (&t->s_page_lock);
   return h_elem != NULL ? hash_entry (h_elem, struct s_page, h_elem) : NULL;
 }
 
@@ -175,6 +647,16 @@ less_func (const struct hash_elem *a, const struct hash_elem *b, void *aux) {
   return ((page_a->uaddr) < (page_b->uaddr));
 }
 
+static void
+s_page_free (struct hash_elem *element, void *aux UNUSED) {
+  struct s_page *page = hash_entry(element, struct s_page, h_elem);
+
+  s_page_unload (page);
+  if (page->location == SWAP && page->swap_slot != SWAP_ERROR)
+    swap_free (page->swap_slot);
+  free (page);
+}
+
 bool
 is_stack_access (void *addr, void *esp) {
   return (esp - 32 <= addr) && is_user_vaddr(addr);
@@ -183,5 +665,5 @@ is_stack_access (void *addr, void *esp) {
 bool
 grow_stack (void *addr) {
   s_page_insert_zero(pg_round_down(addr));
-  return s_page_load (page_lookup (addr));
+  return s_page_load (page_lookup (addr), true);
 }
@@ -8,13 +8,25 @@ enum page_location {
   ZERO
 };
 
-struct hash s_page_table;
-struct lock s_page_lock;
+/* A file mapped into memory by the mmap system call. */
+struct mmap {
+  int mapid;
+  struct file *file;                /* Our own reopened handle. */
+  uint8_t *addr;                    /* First mapped page. */
+  size_t page_cnt;                  /* Number of mapped pages. */
+  struct list_elem elem;            /* Element in owner's mmap_list. */
+};
 
 struct s_page {
   uint8_t *uaddr;
   enum page_location location;
   bool writable;
+  struct thread *owner;             /* Process whose page this is. */
+
+  /* Frame holding the page, or a null pointer if it is not
+     resident.  Owned by vm/frame.c, under its lock. */
+  uint8_t *kpage;
+  struct list_elem frame_elem;
 
   struct {
     /* Info for file page */
@@ -24,15 +36,34 @@ struct s_page {
     uint32_t zero_bytes;
   } file_info;
 
-  /* Info for swap page */
+  /* Mapping a DISK page belongs to, or a null pointer.  Such a
+     page is written back to its file rather than to swap. */
+  struct mmap *mmap;
+
+  /* Info for swap page.  A SWAP page that has been read back in
+     has SWAP_SLOT set to SWAP_ERROR, and goes to swap again when
+     it is evicted. */
+  size_t swap_slot;
 
   struct hash_elem h_elem;
 };
 
+/* Fault-around window, set by -fa. */
+extern size_t fault_around_pages;
+extern bool fault_around_report;
+
 void s_page_init (void);
+void s_page_destroy (void);
 bool s_page_insert_file (uint8_t *, struct file *, off_t, uint32_t, uint32_t, bool);
 bool s_page_insert_zero (uint8_t *);
-bool s_page_load (struct s_page *);
+bool s_page_load (struct s_page *, bool);
+bool s_page_fork (struct thread *);
+bool s_page_unshare (struct s_page *);
+bool s_page_pin_range (const void *, size_t, bool, void *);
+void s_page_unpin_range (const void *, size_t);
+void s_page_write_back (struct s_page *, const void *);
+int s_page_mmap (struct file *, uint8_t *);
+bool s_page_munmap (int);
 struct s_page *page_lookup (const void *);
 
 bool is_stack_access (void *, void *);
@@ -1,10 +1,254 @@
 #include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "vm/lz.h"
 #include "vm/swap.h"
 
+/* Number of swap disk sectors per page-sized slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Largest compressed page kept in memory.  Anything bigger saves
+   too little to be worth it, and would no longer fit in a malloc
+   arena block. */
+#define SWAP_CACHE_MAX_SIZE (PGSIZE / 2)
+
+/* Where a swap slot's contents are. */
+enum slot_where
+  {
+    SLOT_DISK,                  /* On the swap disk. */
+    SLOT_COMPRESSED,            /* Compressed in memory. */
+    SLOT_FILLED                 /* Every word of the page is FILL. */
+  };
+
+/* A swap slot. */
+struct swap_slot
+  {
+    uint16_t ref_cnt;           /* Pages sharing the slot. */
+    uint16_t size;              /* Compressed size. */
+    enum slot_where where;
+    union
+      {
+        void *data;             /* SLOT_COMPRESSED contents. */
+        uint32_t fill;          /* SLOT_FILLED word. */
+      } u;
+  };
+
+static struct disk *swap_disk;
+static struct bitmap *swap_table;       /* Used slots are true. */
+static struct swap_slot *swap_slots;
+static struct lock swap_lock;
+
+/* Kernel memory the compressed swap cache may use, in bytes.
+   Zero turns the cache off.  Set by -zs. */
+size_t swap_cache_limit;
+static size_t swap_cache_used;
+
+/* Compression scratch space, guarded by swap_lock. */
+static uint8_t swap_cache_buf[PGSIZE];
+static uint8_t swap_cache_work[LZ_WORK_SIZE];
+
+/* Statistics. */
+static long long swap_outs;             /* Pages swapped out. */
+static long long swap_filled;           /* ...stored as a fill word. */
+static long long swap_compressed;       /* ...stored compressed. */
+static long long swap_spills;           /* ...written to disk. */
+static long long swap_cache_hits;       /* Pages read back from memory. */
+static long long swap_cache_raw;        /* Bytes before compression. */
+static long long swap_cache_packed;     /* Bytes after compression. */
+
+static bool swap_cache_store (struct swap_slot *, const void *);
+static void swap_cache_drop (struct swap_slot *);
+static void swap_unref (size_t);
+
+/* Sets up the swap slots on the swap disk (hd1:1).  Without a
+   swap disk there are no slots, so every swap_out fails.
+
+   The compressed swap cache is a tier in front of the disk, not
+   a store of its own: a page kept in memory still takes up a
+   disk slot, so the cache needs a swap disk and can hold no more
+   pages than it has slots.  Once the cache is full, further pages
+   go to disk, and a page stays cached until it is swapped in or
+   freed; nothing is moved from the cache to disk to make room. */
 void
 swap_init () {
-  int swap_pages = disk_size (disk_get (1,1)) / (PGSIZE / DISK_SECTOR_SIZE);
+  size_t swap_pages = 0;
+
+  swap_disk = disk_get (1,1);
+  if (swap_disk != NULL)
+    swap_pages = disk_size (swap_disk) / SECTORS_PER_SLOT;
+  else if (swap_cache_limit > 0)
+    PANIC ("swap: -zs needs a swap disk");
+  else
+    printf ("swap: no swap disk, paging to swap disabled\n");
 
   swap_table = bitmap_create (swap_pages);
+  swap_slots = calloc (swap_pages + 1, sizeof *swap_slots);
+  if (swap_table == NULL || swap_slots == NULL)
+    PANIC ("swap: bitmap creation failed");
+  lock_init (&swap_lock);
+}
+
+/* Saves the page at KPAGE in a free swap slot and returns the
+   slot, or SWAP_ERROR if swap is full.  With the swap cache on,
+   the page is kept in memory, compressed, unless the cache is
+   full or the page does not compress. */
+size_t
+swap_out (const void *kpage) {
+  struct swap_slot *s;
+  size_t slot;
+  bool cached;
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+  if (slot == BITMAP_ERROR) {
+    lock_release (&swap_lock);
+    return SWAP_ERROR;
+  }
+  s = &swap_slots[slot];
+  s->ref_cnt = 1;
+  swap_outs++;
+  cached = swap_cache_limit > 0 && swap_cache_store (s, kpage);
+  if (!cached) {
+    s->where = SLOT_DISK;
+    if (swap_cache_limit > 0)
+      swap_spills++;
+  }
+  lock_release (&swap_lock);
+
+  if (!cached)
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+      disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+                  (const uint8_t *) kpage + i * DISK_SECTOR_SIZE);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and drops one
+   reference to the slot. */
+void
+swap_in (size_t slot, void *kpage) {
+  struct swap_slot *s = &swap_slots[slot];
+  bool cached = s->where != SLOT_DISK;
+  size_t i;
+
+  ASSERT (bitmap_test (swap_table, slot));
+
+  /* The slot cannot change under us: we hold a reference. */
+  if (s->where == SLOT_FILLED) {
+    uint32_t *p = kpage;
+
+    for (i = 0; i < PGSIZE / sizeof *p; i++)
+      p[i] = s->u.fill;
+  } else if (s->where == SLOT_COMPRESSED) {
+    if (!lz_decompress (s->u.data, s->size, kpage, PGSIZE))
+      PANIC ("swap: corrupt compressed page in slot %zu", slot);
+  } else {
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+      disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+                 (uint8_t *) kpage + i * DISK_SECTOR_SIZE);
+  }
+
+  lock_acquire (&swap_lock);
+  if (cached)
+    swap_cache_hits++;
+  swap_unref (slot);
+  lock_release (&swap_lock);
+}
+
+/* Adds a reference to swap slot SLOT, for a page that now shares
+   it with another, as after fork. */
+void
+swap_dup (size_t slot) {
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_table, slot));
+  swap_slots[slot].ref_cnt++;
+  lock_release (&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT without reading it back,
+   freeing the slot with the last one. */
+void
+swap_free (size_t slot) {
+  lock_acquire (&swap_lock);
+  swap_unref (slot);
+  lock_release (&swap_lock);
+}
+
+/* Drops a reference to swap slot SLOT, freeing the slot with the
+   last one.  Called with swap_lock held. */
+static void
+swap_unref (size_t slot) {
+  struct swap_slot *s = &swap_slots[slot];
+
+  ASSERT (bitmap_test (swap_table, slot));
+  if (--s->ref_cnt == 0) {
+    swap_cache_drop (s);
+    bitmap_reset (swap_table, slot);
+  }
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) {
+  if (swap_cache_limit == 0) {
+    printf ("Swap: %lld pages swapped out\n", swap_outs);
+    return;
+  }
+  printf ("Swap: %lld pages swapped out, %lld same-filled, "
+          "%lld compressed, %lld spilled to disk\n",
+          swap_outs, swap_filled, swap_compressed, swap_spills);
+  printf ("Swap: %lld pages read back from the swap cache, "
+          "compressed to %lld%% of their size\n", swap_cache_hits,
+          swap_cache_raw > 0 ? swap_cache_packed * 100 / swap_cache_raw : 0);
+}
+
+/* Tries to keep the page at KPAGE in slot S in memory, as a fill
+   word if every word of it is the same, else compressed.  Returns
+   false if it must go to disk instead.  Called with swap_lock
+   held. */
+static bool
+swap_cache_store (struct swap_slot *s, const void *kpage) {
+  const uint32_t *p = kpage;
+  size_t size;
+  size_t i;
+
+  for (i = 1; i < PGSIZE / sizeof *p; i++)
+    if (p[i] != p[0])
+      break;
+  if (i == PGSIZE / sizeof *p) {
+    s->where = SLOT_FILLED;
+    s->u.fill = p[0];
+    swap_filled++;
+    return true;
+  }
+
+  size = lz_compress (kpage, PGSIZE, swap_cache_buf, SWAP_CACHE_MAX_SIZE,
+                      swap_cache_work);
+  if (size == 0 || swap_cache_used + size > swap_cache_limit)
+    return false;
+  s->u.data = malloc (size);
+  if (s->u.data == NULL)
+    return false;
+  memcpy (s->u.data, swap_cache_buf, size);
+  s->where = SLOT_COMPRESSED;
+  s->size = size;
+  swap_cache_used += size;
+  swap_compressed++;
+  swap_cache_raw += PGSIZE;
+  swap_cache_packed += size;
+  return true;
+}
+
+/* Frees whatever memory slot S holds.  Called with swap_lock
+   held. */
+static void
+swap_cache_drop (struct swap_slot *s) {
+  if (s->where == SLOT_COMPRESSED) {
+    free (s->u.data);
+    swap_cache_used -= s->size;
+  }
+  s->where = SLOT_DISK;
 }
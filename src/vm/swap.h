@@ -1,13 +1,15 @@
 #include <bitmap.h>
-#include "vm/page.h"
-#include "devices/disk.h"
+#include <stddef.h>
 
-static struct bitmap *swap_table;
+/* Returned by swap_out when no swap slot is free. */
+#define SWAP_ERROR BITMAP_ERROR
 
-void swap_init (void);
+/* Memory for the compressed swap cache, set by -zs. */
+extern size_t swap_cache_limit;
 
-/*
-bool swap_in (uint8_t *);
-bool swap_out (uint8_t *);
-bool swap_find (
-*/
+void swap_init (void);
+size_t swap_out (const void *);
+void swap_in (size_t, void *);
+void swap_dup (size_t);
+void swap_free (size_t);
+void swap_print_stats (void);